@@ -1,5 +1,6 @@
 #include <gbm.h>
 #include <stdlib.h>
+#include <wlr/types/wlr_box.h>
 #include <wlr/util/log.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -76,17 +77,18 @@ static inline void atomic_add(struct atomic *atom, uint32_t id, uint32_t prop, u
 }
 
 static void set_plane_props(struct atomic *atom, struct wlr_drm_plane *plane,
-		uint32_t crtc_id, uint32_t fb_id, bool set_crtc_xy) {
+		uint32_t crtc_id, uint32_t fb_id, uint32_t width, uint32_t height,
+		bool set_crtc_xy) {
 	uint32_t id = plane->id;
 	const union wlr_drm_plane_props *props = &plane->props;
 
 	// The src_* properties are in 16.16 fixed point
 	atomic_add(atom, id, props->src_x, 0);
 	atomic_add(atom, id, props->src_y, 0);
-	atomic_add(atom, id, props->src_w, plane->surf.width << 16);
-	atomic_add(atom, id, props->src_h, plane->surf.height << 16);
-	atomic_add(atom, id, props->crtc_w, plane->surf.width);
-	atomic_add(atom, id, props->crtc_h, plane->surf.height);
+	atomic_add(atom, id, props->src_w, width << 16);
+	atomic_add(atom, id, props->src_h, height << 16);
+	atomic_add(atom, id, props->crtc_w, width);
+	atomic_add(atom, id, props->crtc_h, height);
 	atomic_add(atom, id, props->fb_id, fb_id);
 	atomic_add(atom, id, props->crtc_id, crtc_id);
 	if (set_crtc_xy) {
@@ -95,6 +97,30 @@ static void set_plane_props(struct atomic *atom, struct wlr_drm_plane *plane,
 	}
 }
 
+static void set_overlay_props(struct atomic *atom, struct wlr_drm_plane *plane,
+		uint32_t crtc_id, struct gbm_bo *bo, const struct wlr_box *box) {
+	uint32_t id = plane->id;
+	const union wlr_drm_plane_props *props = &plane->props;
+
+	if (!bo) {
+		atomic_add(atom, id, props->fb_id, 0);
+		atomic_add(atom, id, props->crtc_id, 0);
+		return;
+	}
+
+	// The src_* properties are in 16.16 fixed point
+	atomic_add(atom, id, props->src_x, 0);
+	atomic_add(atom, id, props->src_y, 0);
+	atomic_add(atom, id, props->src_w, gbm_bo_get_width(bo) << 16);
+	atomic_add(atom, id, props->src_h, gbm_bo_get_height(bo) << 16);
+	atomic_add(atom, id, props->crtc_x, box->x);
+	atomic_add(atom, id, props->crtc_y, box->y);
+	atomic_add(atom, id, props->crtc_w, box->width);
+	atomic_add(atom, id, props->crtc_h, box->height);
+	atomic_add(atom, id, props->fb_id, get_fb_for_bo(bo));
+	atomic_add(atom, id, props->crtc_id, crtc_id);
+}
+
 static bool atomic_crtc_pageflip(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn,
 		struct wlr_drm_crtc *crtc,
@@ -122,10 +148,65 @@ static bool atomic_crtc_pageflip(struct wlr_drm_backend *drm,
 	atomic_add(&atom, conn->id, conn->props.crtc_id, crtc->id);
 	atomic_add(&atom, crtc->id, crtc->props.mode_id, crtc->mode_id);
 	atomic_add(&atom, crtc->id, crtc->props.active, 1);
-	set_plane_props(&atom, crtc->primary, crtc->id, fb_id, true);
+	set_plane_props(&atom, crtc->primary, crtc->id, fb_id,
+		crtc->primary->surf.width, crtc->primary->surf.height, true);
+
+	struct wlr_drm_plane *overlay = crtc->overlay;
+	if (overlay && (overlay->overlay.bo || overlay->overlay_back.bo)) {
+		set_overlay_props(&atom, overlay, crtc->id, overlay->overlay.bo,
+			&overlay->overlay_box);
+	}
+
 	return atomic_commit(drm->fd, &atom, conn, flags, mode);
 }
 
+static bool atomic_crtc_test_fb(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		uint32_t fb_id) {
+	struct atomic atom = {0};
+	atomic_begin(crtc, &atom);
+	set_plane_props(&atom, crtc->primary, crtc->id, fb_id,
+		crtc->primary->surf.width, crtc->primary->surf.height, true);
+
+	bool ok = !atom.failed && !drmModeAtomicCommit(drm->fd, atom.req,
+		DRM_MODE_ATOMIC_TEST_ONLY, NULL);
+	if (!ok) {
+		wlr_log_errno(L_DEBUG, "%s: Atomic test of framebuffer failed",
+			conn->output.name);
+	}
+
+	// Never keep the tested properties around, crtc_pageflip sets them again
+	if (atom.req) {
+		drmModeAtomicSetCursor(atom.req, atom.cursor);
+	}
+	return ok;
+}
+
+static bool atomic_crtc_test_overlay(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		struct gbm_bo *bo, const struct wlr_box *box) {
+	if (!crtc->overlay) {
+		return false;
+	}
+
+	// The current state of the other planes is checked along the overlay
+	struct atomic atom = {0};
+	atomic_begin(crtc, &atom);
+	set_overlay_props(&atom, crtc->overlay, crtc->id, bo, box);
+
+	bool ok = !atom.failed && !drmModeAtomicCommit(drm->fd, atom.req,
+		DRM_MODE_ATOMIC_TEST_ONLY, NULL);
+	if (!ok) {
+		wlr_log_errno(L_DEBUG, "%s: Atomic test of overlay plane failed",
+			conn->output.name);
+	}
+
+	if (atom.req) {
+		drmModeAtomicSetCursor(atom.req, atom.cursor);
+	}
+	return ok;
+}
+
 static bool atomic_conn_enable(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, bool enable) {
 	struct wlr_drm_crtc *crtc = conn->crtc;
@@ -164,7 +245,8 @@ static bool atomic_crtc_set_cursor(struct wlr_drm_backend *drm,
 	atomic_begin(crtc, &atom);
 
 	if (bo) {
-		set_plane_props(&atom, plane, crtc->id, get_fb_for_bo(bo), false);
+		set_plane_props(&atom, plane, crtc->id, get_fb_for_bo(bo),
+			gbm_bo_get_width(bo), gbm_bo_get_height(bo), false);
 	} else {
 		atomic_add(&atom, plane->id, plane->props.fb_id, 0);
 		atomic_add(&atom, plane->id, plane->props.crtc_id, 0);
@@ -249,6 +331,8 @@ static uint32_t atomic_crtc_get_gamma_size(struct wlr_drm_backend *drm,
 const struct wlr_drm_interface atomic_iface = {
 	.conn_enable = atomic_conn_enable,
 	.crtc_pageflip = atomic_crtc_pageflip,
+	.crtc_test_fb = atomic_crtc_test_fb,
+	.crtc_test_overlay = atomic_crtc_test_overlay,
 	.crtc_set_cursor = atomic_crtc_set_cursor,
 	.crtc_move_cursor = atomic_crtc_move_cursor,
 	.crtc_set_gamma = atomic_crtc_set_gamma,
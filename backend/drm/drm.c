@@ -4,8 +4,6 @@
 #include <EGL/eglext.h>
 #include <errno.h>
 #include <gbm.h>
-#include <GLES2/gl2.h>
-#include <GLES2/gl2ext.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,7 +15,6 @@
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render.h>
 #include <wlr/render/gles2.h>
-#include <wlr/render/matrix.h>
 #include <wlr/util/log.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -43,6 +40,10 @@ bool wlr_drm_check_features(struct wlr_drm_backend *drm) {
 		drm->iface = &atomic_iface;
 	}
 
+	uint64_t cap;
+	drm->monotonic_timestamps =
+		drmGetCap(drm->fd, DRM_CAP_TIMESTAMP_MONOTONIC, &cap) == 0 && cap == 1;
+
 	return true;
 }
 
@@ -178,11 +179,11 @@ void wlr_drm_resources_free(struct wlr_drm_backend *drm) {
 	}
 	for (size_t i = 0; i < drm->num_planes; ++i) {
 		struct wlr_drm_plane *plane = &drm->planes[i];
-		if (plane->cursor_bo) {
-			gbm_bo_destroy(plane->cursor_bo);
-		}
-		if (plane->wlr_tex) {
-			wlr_texture_destroy(plane->wlr_tex);
+		for (size_t j = 0; j < WLR_DRM_CURSOR_CACHE_SIZE; ++j) {
+			if (plane->cursor_bos[j].bo) {
+				gbm_bo_destroy(plane->cursor_bos[j].bo);
+			}
+			free(plane->cursor_bos[j].pixels);
 		}
 	}
 
@@ -190,6 +191,38 @@ void wlr_drm_resources_free(struct wlr_drm_backend *drm) {
 	free(drm->planes);
 }
 
+/**
+ * Keeps track of the overlay buffers after a successful pageflip, which
+ * committed the wanted overlay plane state.
+ */
+static void overlay_plane_flipped(struct wlr_drm_crtc *crtc) {
+	struct wlr_drm_plane *plane = crtc->overlay;
+	if (!plane || plane->overlay_back.bo == plane->overlay.bo) {
+		return;
+	}
+
+	// overlay_back now owns the committed buffer, overlay aliases it
+	wlr_drm_client_bo_release(&plane->overlay_front);
+	plane->overlay_front = plane->overlay_back;
+	plane->overlay_back = plane->overlay;
+}
+
+static void overlay_plane_post(struct wlr_drm_crtc *crtc) {
+	struct wlr_drm_plane *plane = crtc->overlay;
+	if (plane) {
+		wlr_drm_client_bo_release(&plane->overlay_front);
+	}
+}
+
+static void overlay_plane_finish(struct wlr_drm_plane *plane) {
+	if (plane->overlay.bo != plane->overlay_back.bo) {
+		wlr_drm_client_bo_release(&plane->overlay);
+	}
+	wlr_drm_client_bo_release(&plane->overlay_back);
+	wlr_drm_client_bo_release(&plane->overlay_front);
+	plane->overlay = (struct wlr_drm_client_bo){0};
+}
+
 static bool wlr_drm_connector_make_current(struct wlr_output *output,
 		int *buffer_age) {
 	struct wlr_drm_connector *conn = (struct wlr_drm_connector *)output;
@@ -225,11 +258,90 @@ static bool wlr_drm_connector_swap_buffers(struct wlr_output *output,
 		return false;
 	}
 
+	wlr_drm_surface_set_scanout(&plane->surf, NULL);
+	overlay_plane_flipped(crtc);
 	conn->pageflip_pending = true;
 	wlr_output_update_enabled(output, true);
 	return true;
 }
 
+static bool wlr_drm_connector_scanout_buffer(struct wlr_output *output,
+		struct wlr_surface_buffer *buffer) {
+	struct wlr_drm_connector *conn = (struct wlr_drm_connector *)output;
+	struct wlr_drm_backend *drm = (struct wlr_drm_backend *)output->backend;
+	// Client buffers are allocated on the parent GPU in multi-GPU setups
+	if (!drm->session->active || drm->parent || conn->pageflip_pending) {
+		return false;
+	}
+
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!crtc) {
+		return false;
+	}
+	struct wlr_drm_plane *plane = crtc->primary;
+
+	struct wlr_drm_client_bo cbo;
+	if (!wlr_drm_surface_import_buffer(&plane->surf, &cbo, buffer)) {
+		return false;
+	}
+
+	uint32_t fb_id = get_fb_for_bo(cbo.bo);
+	if (!fb_id || !drm->iface->crtc_test_fb(drm, conn, crtc, fb_id) ||
+			!drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, NULL)) {
+		wlr_drm_client_bo_release(&cbo);
+		return false;
+	}
+
+	// The client buffer stays referenced until the page-flip replacing it
+	// has completed
+	wlr_drm_surface_set_scanout(&plane->surf, &cbo);
+	overlay_plane_flipped(crtc);
+	conn->pageflip_pending = true;
+	wlr_output_update_enabled(output, true);
+	return true;
+}
+
+static bool wlr_drm_connector_set_overlay(struct wlr_output *output,
+		struct wlr_surface_buffer *buffer, const struct wlr_box *box) {
+	struct wlr_drm_connector *conn = (struct wlr_drm_connector *)output;
+	struct wlr_drm_backend *drm = (struct wlr_drm_backend *)output->backend;
+
+	struct wlr_drm_crtc *crtc = conn->crtc;
+	if (!crtc || !crtc->overlay) {
+		return buffer == NULL;
+	}
+	struct wlr_drm_plane *plane = crtc->overlay;
+
+	// Nothing to do if the same buffer stays at the same place
+	if (buffer && plane->overlay.buffer == buffer &&
+			plane->overlay_box.x == box->x && plane->overlay_box.y == box->y &&
+			plane->overlay_box.width == box->width &&
+			plane->overlay_box.height == box->height) {
+		return true;
+	}
+
+	// Client buffers are allocated on the parent GPU in multi-GPU setups
+	struct wlr_drm_client_bo cbo = {0};
+	if (buffer && drm->session->active && !drm->parent &&
+			wlr_drm_client_bo_import(&cbo, &drm->renderer, buffer)) {
+		if (!get_fb_for_bo(cbo.bo) ||
+				!drm->iface->crtc_test_overlay(drm, conn, crtc, cbo.bo, box)) {
+			wlr_drm_client_bo_release(&cbo);
+		}
+	}
+
+	// The previous buffer can be dropped right away if it was never committed
+	if (plane->overlay.bo != plane->overlay_back.bo) {
+		wlr_drm_client_bo_release(&plane->overlay);
+	}
+	plane->overlay = cbo;
+	if (cbo.bo) {
+		plane->overlay_box = *box;
+	}
+
+	return cbo.bo || !buffer;
+}
+
 static void wlr_drm_connector_set_gamma(struct wlr_output *output,
 		uint32_t size, uint16_t *r, uint16_t *g, uint16_t *b) {
 	struct wlr_drm_connector *conn = (struct wlr_drm_connector *)output;
@@ -274,6 +386,7 @@ void wlr_drm_connector_start_renderer(struct wlr_drm_connector *conn) {
 
 	struct wlr_drm_mode *mode = (struct wlr_drm_mode *)conn->output.current_mode;
 	if (drm->iface->crtc_pageflip(drm, conn, crtc, fb_id, &mode->drm_mode)) {
+		overlay_plane_flipped(crtc);
 		conn->pageflip_pending = true;
 		wlr_output_update_enabled(&conn->output, true);
 	} else {
@@ -533,6 +646,77 @@ static void wlr_drm_connector_transform(struct wlr_output *output,
 	output->transform = transform;
 }
 
+/**
+ * Copies an ARGB8888 cursor image into a cursor buffer, applying a transform.
+ * The image is placed in the top-left corner of the untransformed buffer,
+ * like the hotspot. The rest of the buffer is cleared.
+ */
+static void copy_cursor_pixels(uint8_t *dst, uint32_t dst_stride,
+		uint32_t dst_width, uint32_t dst_height, const uint8_t *src,
+		int32_t src_stride, uint32_t width, uint32_t height,
+		enum wl_output_transform transform) {
+	for (uint32_t y = 0; y < dst_height; ++y) {
+		memset(dst + y * dst_stride, 0, dst_width * 4);
+	}
+
+	if (transform == WL_OUTPUT_TRANSFORM_NORMAL) {
+		for (uint32_t y = 0; y < height; ++y) {
+			memcpy(dst + y * dst_stride, src + y * src_stride, width * 4);
+		}
+		return;
+	}
+
+	// The transform is affine: find where the first pixel goes, and the
+	// offsets of the next pixel in a row and in a column
+	struct wlr_box origin = { .x = 0, .y = 0, .width = 1, .height = 1 };
+	struct wlr_box next_x = { .x = 1, .y = 0, .width = 1, .height = 1 };
+	struct wlr_box next_y = { .x = 0, .y = 1, .width = 1, .height = 1 };
+	wlr_box_transform(&origin, transform, dst_width, dst_height, &origin);
+	wlr_box_transform(&next_x, transform, dst_width, dst_height, &next_x);
+	wlr_box_transform(&next_y, transform, dst_width, dst_height, &next_y);
+
+	uint32_t pixel_stride = dst_stride / 4;
+	ptrdiff_t step_x = (next_x.y - origin.y) * (ptrdiff_t)pixel_stride +
+		(next_x.x - origin.x);
+	ptrdiff_t step_y = (next_y.y - origin.y) * (ptrdiff_t)pixel_stride +
+		(next_y.x - origin.x);
+
+	uint32_t *dst_pixels = (uint32_t *)dst;
+	uint32_t *dst_row = dst_pixels + origin.y * pixel_stride + origin.x;
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint32_t *src_row = (const uint32_t *)(src + y * src_stride);
+		for (uint32_t x = 0; x < width; ++x) {
+			dst_row[x * step_x] = src_row[x];
+		}
+		dst_row += step_y;
+	}
+}
+
+static uint64_t cursor_pixels_hash(const uint8_t *buf, int32_t stride,
+		uint32_t width, uint32_t height) {
+	// FNV-1a, one pixel at a time
+	uint64_t hash = 0xcbf29ce484222325;
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint32_t *row = (const uint32_t *)(buf + y * stride);
+		for (uint32_t x = 0; x < width; ++x) {
+			hash ^= row[x];
+			hash *= 0x100000001b3;
+		}
+	}
+	return hash;
+}
+
+static bool cursor_pixels_equal(const uint32_t *pixels, const uint8_t *buf,
+		int32_t stride, uint32_t width, uint32_t height) {
+	for (uint32_t y = 0; y < height; ++y) {
+		if (memcmp(pixels + y * width, buf + y * stride,
+				width * sizeof(uint32_t)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
 static bool wlr_drm_connector_set_cursor(struct wlr_output *output,
 		const uint8_t *buf, int32_t stride, uint32_t width, uint32_t height,
 		int32_t hotspot_x, int32_t hotspot_y, bool update_pixels) {
@@ -564,48 +748,21 @@ static bool wlr_drm_connector_set_cursor(struct wlr_output *output,
 		}
 		return drm->iface->crtc_set_cursor(drm, crtc, NULL);
 	}
+	bool was_enabled = plane->cursor_enabled;
 	plane->cursor_enabled = true;
 
-	if (!plane->surf.gbm) {
+	if (plane->cursor_width == 0) {
 		int ret;
 		uint64_t w, h;
 		ret = drmGetCap(drm->fd, DRM_CAP_CURSOR_WIDTH, &w);
 		w = ret ? 64 : w;
 		ret = drmGetCap(drm->fd, DRM_CAP_CURSOR_HEIGHT, &h);
 		h = ret ? 64 : h;
-
-		if (width > w || height > h) {
-			wlr_log(L_INFO, "Cursor too large (max %dx%d)", (int)w, (int)h);
-			return false;
-		}
-
-		if (!wlr_drm_surface_init(&plane->surf, renderer, w, h,
-				GBM_FORMAT_ARGB8888, 0)) {
-			wlr_log(L_ERROR, "Cannot allocate cursor resources");
-			return false;
-		}
-
-		plane->cursor_bo = gbm_bo_create(renderer->gbm, w, h,
-			GBM_FORMAT_ARGB8888, GBM_BO_USE_CURSOR | GBM_BO_USE_WRITE);
-		if (!plane->cursor_bo) {
-			wlr_log_errno(L_ERROR, "Failed to create cursor bo");
-			return false;
-		}
-
-		// OpenGL will read the pixels out upside down,
-		// so we need to flip the image vertically
-		enum wl_output_transform transform = wlr_output_transform_compose(
-			wlr_output_transform_invert(output->transform),
-			WL_OUTPUT_TRANSFORM_FLIPPED_180);
-		wlr_matrix_texture(plane->matrix, plane->surf.width, plane->surf.height,
-			transform);
-
-		plane->wlr_tex =
-			wlr_render_texture_create(plane->surf.renderer->wlr_rend);
-		if (!plane->wlr_tex) {
-			return false;
-		}
+		plane->cursor_width = w;
+		plane->cursor_height = h;
 	}
+	uint32_t bo_width = plane->cursor_width;
+	uint32_t bo_height = plane->cursor_height;
 
 	struct wlr_box hotspot = {
 		.x = hotspot_x,
@@ -613,8 +770,7 @@ static bool wlr_drm_connector_set_cursor(struct wlr_output *output,
 	};
 	enum wl_output_transform transform =
 		wlr_output_transform_invert(output->transform);
-	wlr_box_transform(&hotspot, transform,
-		plane->surf.width, plane->surf.height, &hotspot);
+	wlr_box_transform(&hotspot, transform, bo_width, bo_height, &hotspot);
 	plane->cursor_hotspot_x = hotspot.x;
 	plane->cursor_hotspot_y = hotspot.y;
 
@@ -623,47 +779,95 @@ static bool wlr_drm_connector_set_cursor(struct wlr_output *output,
 		return true;
 	}
 
-	struct gbm_bo *bo = plane->cursor_bo;
-	uint32_t bo_width = gbm_bo_get_width(bo);
-	uint32_t bo_height = gbm_bo_get_height(bo);
-	uint32_t bo_stride;
-	void *bo_data;
-
-	if (!gbm_bo_map(bo, 0, 0, bo_width, bo_height,
-			GBM_BO_TRANSFER_WRITE, &bo_stride, &bo_data)) {
-		wlr_log_errno(L_ERROR, "Unable to map buffer");
+	// The transformed image must fit in the buffer
+	struct wlr_box image = { .width = width, .height = height };
+	wlr_box_transform(&image, transform, bo_width, bo_height, &image);
+	if (image.x < 0 || image.y < 0 ||
+			(uint32_t)(image.x + image.width) > bo_width ||
+			(uint32_t)(image.y + image.height) > bo_height) {
+		wlr_log(L_INFO, "Cursor too large (max %"PRIu32"x%"PRIu32")",
+			bo_width, bo_height);
 		return false;
 	}
 
-	wlr_drm_surface_make_current(&plane->surf, NULL);
-
-	wlr_texture_upload_pixels(plane->wlr_tex, WL_SHM_FORMAT_ARGB8888,
-		stride, width, height, buf);
+	// Look for a buffer already holding this image. Otherwise, reuse the
+	// least recently used buffer, but never the one being scanned out.
+	uint64_t hash = cursor_pixels_hash(buf, stride, width, height);
+	struct wlr_drm_cursor_bo *entry = NULL, *lru = NULL;
+	for (size_t i = 0; i < WLR_DRM_CURSOR_CACHE_SIZE; ++i) {
+		struct wlr_drm_cursor_bo *e = &plane->cursor_bos[i];
+		if (e->bo != NULL && e->width == width && e->height == height &&
+				e->transform == transform && e->hash == hash &&
+				cursor_pixels_equal(e->pixels, buf, stride, width, height)) {
+			entry = e;
+			break;
+		}
+		if (e->bo != NULL && e->bo == plane->cursor_bo) {
+			continue;
+		}
+		if (lru == NULL || e->last_used < lru->last_used) {
+			lru = e;
+		}
+	}
 
-	glViewport(0, 0, plane->surf.width, plane->surf.height);
-	glClearColor(0.0, 0.0, 0.0, 0.0);
-	glClear(GL_COLOR_BUFFER_BIT);
+	if (entry == NULL) {
+		entry = lru;
 
-	float matrix[16];
-	wlr_texture_get_matrix(plane->wlr_tex, &matrix, &plane->matrix, 0, 0);
-	wlr_render_with_matrix(plane->surf.renderer->wlr_rend, plane->wlr_tex,
-		&matrix);
+		// Keep a copy of the image, so that a hash collision can't display
+		// the wrong cursor
+		uint32_t *pixels = realloc(entry->pixels,
+			width * height * sizeof(uint32_t));
+		if (pixels == NULL) {
+			wlr_log_errno(L_ERROR, "Allocation failed");
+			return false;
+		}
+		entry->pixels = pixels;
+		// The entry doesn't match any image until it is filled
+		entry->width = entry->height = 0;
+
+		if (entry->bo == NULL) {
+			entry->bo = gbm_bo_create(renderer->gbm, bo_width, bo_height,
+				GBM_FORMAT_ARGB8888, GBM_BO_USE_CURSOR | GBM_BO_USE_WRITE);
+			if (entry->bo == NULL) {
+				wlr_log_errno(L_ERROR, "Failed to create cursor bo");
+				return false;
+			}
+		}
 
-	glFinish();
-	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, bo_stride);
-	glReadPixels(0, 0, plane->surf.width, plane->surf.height, GL_BGRA_EXT,
-		GL_UNSIGNED_BYTE, bo_data);
-	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+		uint32_t bo_stride;
+		void *map_data = NULL;
+		void *bo_data = gbm_bo_map(entry->bo, 0, 0, bo_width, bo_height,
+			GBM_BO_TRANSFER_WRITE, &bo_stride, &map_data);
+		if (!bo_data) {
+			wlr_log_errno(L_ERROR, "Unable to map buffer");
+			return false;
+		}
+		copy_cursor_pixels(bo_data, bo_stride, bo_width, bo_height, buf,
+			stride, width, height, transform);
+		gbm_bo_unmap(entry->bo, map_data);
 
-	wlr_drm_surface_swap_buffers(&plane->surf, NULL);
+		for (uint32_t y = 0; y < height; ++y) {
+			memcpy(pixels + y * width, buf + y * stride,
+				width * sizeof(uint32_t));
+		}
+		entry->width = width;
+		entry->height = height;
+		entry->transform = transform;
+		entry->hash = hash;
+	}
+	entry->last_used = ++plane->cursor_serial;
 
-	gbm_bo_unmap(bo, bo_data);
+	if (was_enabled && plane->cursor_bo == entry->bo) {
+		// Same image as the one being displayed
+		return true;
+	}
+	plane->cursor_bo = entry->bo;
 
 	if (!drm->session->active) {
 		return true;
 	}
 
-	bool ok = drm->iface->crtc_set_cursor(drm, crtc, bo);
+	bool ok = drm->iface->crtc_set_cursor(drm, crtc, entry->bo);
 	if (ok) {
 		wlr_output_update_needs_swap(output);
 	}
@@ -724,6 +928,8 @@ static struct wlr_output_impl output_impl = {
 	.destroy = wlr_drm_connector_destroy,
 	.make_current = wlr_drm_connector_make_current,
 	.swap_buffers = wlr_drm_connector_swap_buffers,
+	.scanout_buffer = wlr_drm_connector_scanout_buffer,
+	.set_overlay = wlr_drm_connector_set_overlay,
 	.set_gamma = wlr_drm_connector_set_gamma,
 	.get_gamma_size = wlr_drm_connector_get_gamma_size,
 };
@@ -916,12 +1122,18 @@ static void page_flip_handler(int fd, unsigned seq,
 	}
 
 	wlr_drm_surface_post(&conn->crtc->primary->surf);
+	overlay_plane_post(conn->crtc);
 	if (drm->parent) {
 		wlr_drm_surface_post(&conn->crtc->primary->mgpu_surf);
 	}
 
 	if (drm->session->active) {
-		wlr_output_send_frame(&conn->output);
+		struct timespec present = {
+			.tv_sec = tv_sec,
+			.tv_nsec = tv_usec * 1000,
+		};
+		wlr_output_send_present(&conn->output,
+			drm->monotonic_timestamps ? &present : NULL);
 	}
 }
 
@@ -984,6 +1196,9 @@ void wlr_drm_connector_cleanup(struct wlr_drm_connector *conn) {
 	case WLR_DRM_CONN_CONNECTED:
 	case WLR_DRM_CONN_CLEANUP:;
 		struct wlr_drm_crtc *crtc = conn->crtc;
+		if (crtc->overlay) {
+			overlay_plane_finish(crtc->overlay);
+		}
 		for (int i = 0; i < 3; ++i) {
 			if (!crtc->planes[i]) {
 				continue;
@@ -25,6 +25,21 @@ static bool legacy_crtc_pageflip(struct wlr_drm_backend *drm,
 	return true;
 }
 
+static bool legacy_crtc_test_fb(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		uint32_t fb_id) {
+	// There is no way to test a legacy page-flip, but a failed one has no side
+	// effects so callers can just try it
+	return true;
+}
+
+static bool legacy_crtc_test_overlay(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		struct gbm_bo *bo, const struct wlr_box *box) {
+	// Overlay planes can't be updated along with legacy page-flips
+	return false;
+}
+
 static bool legacy_conn_enable(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, bool enable) {
 	int ret = drmModeConnectorSetProperty(drm->fd, conn->id, conn->props.dpms,
@@ -43,10 +58,8 @@ bool legacy_crtc_set_cursor(struct wlr_drm_backend *drm,
 		return true;
 	}
 
-	struct wlr_drm_plane *plane = crtc->cursor;
-
 	if (drmModeSetCursor(drm->fd, crtc->id, gbm_bo_get_handle(bo).u32,
-			plane->surf.width, plane->surf.height)) {
+			gbm_bo_get_width(bo), gbm_bo_get_height(bo))) {
 		wlr_log_errno(L_ERROR, "Failed to set hardware cursor");
 		return false;
 	}
@@ -73,6 +86,8 @@ uint32_t legacy_crtc_get_gamma_size(struct wlr_drm_backend *drm,
 const struct wlr_drm_interface legacy_iface = {
 	.conn_enable = legacy_conn_enable,
 	.crtc_pageflip = legacy_crtc_pageflip,
+	.crtc_test_fb = legacy_crtc_test_fb,
+	.crtc_test_overlay = legacy_crtc_test_overlay,
 	.crtc_set_cursor = legacy_crtc_set_cursor,
 	.crtc_move_cursor = legacy_crtc_move_cursor,
 	.crtc_set_gamma = legacy_crtc_set_gamma,
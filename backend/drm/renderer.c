@@ -10,6 +10,7 @@
 #include <wlr/render/egl.h>
 #include <wlr/render/gles2.h>
 #include <wlr/render/matrix.h>
+#include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include "backend/drm/drm.h"
 #include "glapi.h"
@@ -115,6 +116,8 @@ void wlr_drm_surface_finish(struct wlr_drm_surface *surf) {
 	if (surf->back) {
 		gbm_surface_release_buffer(surf->gbm, surf->back);
 	}
+	wlr_drm_client_bo_release(&surf->scanout_front);
+	wlr_drm_client_bo_release(&surf->scanout_back);
 
 	if (surf->egl) {
 		eglDestroySurface(surf->renderer->egl.display, surf->egl);
@@ -161,6 +164,61 @@ void wlr_drm_surface_post(struct wlr_drm_surface *surf) {
 		gbm_surface_release_buffer(surf->gbm, surf->front);
 		surf->front = NULL;
 	}
+	wlr_drm_client_bo_release(&surf->scanout_front);
+}
+
+bool wlr_drm_client_bo_import(struct wlr_drm_client_bo *cbo,
+		struct wlr_drm_renderer *renderer, struct wlr_surface_buffer *buffer) {
+	if (buffer->resource == NULL) {
+		return false;
+	}
+
+	struct gbm_bo *bo = gbm_bo_import(renderer->gbm, GBM_BO_IMPORT_WL_BUFFER,
+		buffer->resource, GBM_BO_USE_SCANOUT);
+	if (!bo) {
+		wlr_log(L_DEBUG, "Failed to import buffer for scanout");
+		return false;
+	}
+
+	cbo->bo = bo;
+	cbo->buffer = wlr_surface_buffer_ref(buffer);
+	return true;
+}
+
+void wlr_drm_client_bo_release(struct wlr_drm_client_bo *cbo) {
+	if (cbo->bo) {
+		gbm_bo_destroy(cbo->bo);
+	}
+	wlr_surface_buffer_unref(cbo->buffer);
+	cbo->bo = NULL;
+	cbo->buffer = NULL;
+}
+
+bool wlr_drm_surface_import_buffer(struct wlr_drm_surface *surf,
+		struct wlr_drm_client_bo *cbo, struct wlr_surface_buffer *buffer) {
+	if (!wlr_drm_client_bo_import(cbo, surf->renderer, buffer)) {
+		return false;
+	}
+
+	if (gbm_bo_get_width(cbo->bo) != surf->width ||
+			gbm_bo_get_height(cbo->bo) != surf->height) {
+		wlr_drm_client_bo_release(cbo);
+		return false;
+	}
+
+	return true;
+}
+
+void wlr_drm_surface_set_scanout(struct wlr_drm_surface *surf,
+		struct wlr_drm_client_bo *cbo) {
+	wlr_drm_client_bo_release(&surf->scanout_front);
+
+	surf->scanout_front = surf->scanout_back;
+	if (cbo) {
+		surf->scanout_back = *cbo;
+	} else {
+		surf->scanout_back = (struct wlr_drm_client_bo){0};
+	}
 }
 
 struct tex {
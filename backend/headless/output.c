@@ -30,6 +30,7 @@ static bool output_set_custom_mode(struct wlr_output *wlr_output, int32_t width,
 	}
 
 	output->egl_surface = egl_create_surface(&backend->egl, width, height);
+	output->has_frame = false;
 	if (output->egl_surface == EGL_NO_SURFACE) {
 		wlr_log(L_ERROR, "Failed to recreate EGL surface");
 		wlr_output_destroy(wlr_output);
@@ -52,12 +53,22 @@ static void output_transform(struct wlr_output *wlr_output,
 static bool output_make_current(struct wlr_output *wlr_output, int *buffer_age) {
 	struct wlr_headless_output *output =
 		(struct wlr_headless_output *)wlr_output;
-	return wlr_egl_make_current(&output->backend->egl, output->egl_surface,
-		buffer_age);
+	if (!wlr_egl_make_current(&output->backend->egl, output->egl_surface,
+			NULL)) {
+		return false;
+	}
+	if (buffer_age != NULL) {
+		// Pbuffers are never swapped, their contents are kept between frames
+		*buffer_age = output->has_frame ? 1 : 0;
+	}
+	return true;
 }
 
 static bool output_swap_buffers(struct wlr_output *wlr_output,
 		pixman_region32_t *damage) {
+	struct wlr_headless_output *output =
+		(struct wlr_headless_output *)wlr_output;
+	output->has_frame = true;
 	return true; // No-op
 }
 
@@ -11,11 +11,29 @@
 #include <wlr/backend/drm.h>
 #include <wlr/backend/session.h>
 #include <wlr/render/egl.h>
+#include <wlr/types/wlr_box.h>
 #include <xf86drmMode.h>
 #include "iface.h"
 #include "properties.h"
 #include "renderer.h"
 
+// Number of cursor images kept in buffers by each cursor plane
+#define WLR_DRM_CURSOR_CACHE_SIZE 8
+
+/**
+ * A cursor buffer, holding a transformed cursor image. Buffers are keyed by
+ * the contents of the image, so that switching back to a recently used
+ * cursor doesn't need any upload.
+ */
+struct wlr_drm_cursor_bo {
+	struct gbm_bo *bo; // NULL if not allocated yet
+	uint32_t width, height;
+	enum wl_output_transform transform;
+	uint64_t hash;
+	uint32_t *pixels; // untransformed image, compared on hash matches
+	uint32_t last_used;
+};
+
 struct wlr_drm_plane {
 	uint32_t type;
 	uint32_t id;
@@ -26,12 +44,20 @@ struct wlr_drm_plane {
 	struct wlr_drm_surface mgpu_surf;
 
 	// Only used by cursor
-	float matrix[16];
-	struct wlr_texture *wlr_tex;
-	struct gbm_bo *cursor_bo;
+	struct wlr_drm_cursor_bo cursor_bos[WLR_DRM_CURSOR_CACHE_SIZE];
+	struct gbm_bo *cursor_bo; // displayed, one of cursor_bos
+	uint32_t cursor_width, cursor_height; // size of the buffers
+	uint32_t cursor_serial;
 	bool cursor_enabled;
 	int32_t cursor_hotspot_x, cursor_hotspot_y;
 
+	// Only used by overlay
+	struct wlr_drm_client_bo overlay; // committed on the next pageflip
+	struct wlr_box overlay_box;
+	// overlay_back is displayed, overlay_front is released on the next
+	// pageflip event
+	struct wlr_drm_client_bo overlay_front, overlay_back;
+
 	union wlr_drm_plane_props props;
 };
 
@@ -67,6 +93,8 @@ struct wlr_drm_backend {
 	const struct wlr_drm_interface *iface;
 
 	int fd;
+	// whether page-flip timestamps are on the CLOCK_MONOTONIC clock
+	bool monotonic_timestamps;
 
 	size_t num_crtcs;
 	struct wlr_drm_crtc *crtcs;
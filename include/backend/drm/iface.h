@@ -10,6 +10,7 @@
 struct wlr_drm_backend;
 struct wlr_drm_connector;
 struct wlr_drm_crtc;
+struct wlr_box;
 
 // Used to provide atomic or legacy DRM functions
 struct wlr_drm_interface {
@@ -20,6 +21,14 @@ struct wlr_drm_interface {
 	bool (*crtc_pageflip)(struct wlr_drm_backend *drm,
 		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
 		uint32_t fb_id, drmModeModeInfo *mode);
+	// Check whether fb_id can be scanned out on the primary plane of crtc
+	bool (*crtc_test_fb)(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		uint32_t fb_id);
+	// Check whether bo can be displayed on the overlay plane of crtc at box
+	bool (*crtc_test_overlay)(struct wlr_drm_backend *drm,
+		struct wlr_drm_connector *conn, struct wlr_drm_crtc *crtc,
+		struct gbm_bo *bo, const struct wlr_box *box);
 	// Enable the cursor buffer on crtc. Set bo to NULL to disable
 	bool (*crtc_set_cursor)(struct wlr_drm_backend *drm,
 		struct wlr_drm_crtc *crtc, struct gbm_bo *bo);
@@ -5,10 +5,12 @@
 #include <gbm.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <wayland-server.h>
 #include <wlr/render.h>
 
 struct wlr_drm_backend;
 struct wlr_drm_plane;
+struct wlr_surface_buffer;
 
 struct wlr_drm_renderer {
 	int fd;
@@ -18,6 +20,15 @@ struct wlr_drm_renderer {
 	struct wlr_renderer *wlr_rend;
 };
 
+/**
+ * A client buffer imported for direct scanout. The client buffer isn't
+ * released to the client before the imported buffer.
+ */
+struct wlr_drm_client_bo {
+	struct gbm_bo *bo; // NULL if unset
+	struct wlr_surface_buffer *buffer;
+};
+
 struct wlr_drm_surface {
 	struct wlr_drm_renderer *renderer;
 
@@ -29,6 +40,10 @@ struct wlr_drm_surface {
 
 	struct gbm_bo *front;
 	struct gbm_bo *back;
+
+	// Client buffers imported for direct scanout
+	struct wlr_drm_client_bo scanout_front;
+	struct wlr_drm_client_bo scanout_back;
 };
 
 bool wlr_drm_renderer_init(struct wlr_drm_backend *drm,
@@ -49,6 +64,30 @@ struct gbm_bo *wlr_drm_surface_swap_buffers(struct wlr_drm_surface *surf,
 	pixman_region32_t *damage);
 struct gbm_bo *wlr_drm_surface_get_front(struct wlr_drm_surface *surf);
 void wlr_drm_surface_post(struct wlr_drm_surface *surf);
+/**
+ * Imports a client buffer for direct scanout, and takes a reference to it.
+ * Returns false if the buffer can't be imported.
+ */
+bool wlr_drm_client_bo_import(struct wlr_drm_client_bo *cbo,
+	struct wlr_drm_renderer *renderer, struct wlr_surface_buffer *buffer);
+/**
+ * Destroys the imported buffer and drops the client buffer reference.
+ */
+void wlr_drm_client_bo_release(struct wlr_drm_client_bo *cbo);
+/**
+ * Imports a client buffer for direct scanout. Returns false if the buffer
+ * can't be imported or doesn't match the surface size.
+ */
+bool wlr_drm_surface_import_buffer(struct wlr_drm_surface *surf,
+	struct wlr_drm_client_bo *cbo, struct wlr_surface_buffer *buffer);
+/**
+ * Takes ownership of a buffer which has been queued for scanout. Set cbo to
+ * NULL when going back to the surface's own buffers. The previously scanned
+ * out buffer is released by the next `wlr_drm_surface_post`, once it is
+ * off-screen.
+ */
+void wlr_drm_surface_set_scanout(struct wlr_drm_surface *surf,
+	struct wlr_drm_client_bo *cbo);
 struct gbm_bo *wlr_drm_surface_mgpu_copy(struct wlr_drm_surface *dest,
 	struct gbm_bo *src);
 
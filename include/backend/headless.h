@@ -22,6 +22,7 @@ struct wlr_headless_output {
 	struct wl_list link;
 
 	void *egl_surface;
+	bool has_frame; // whether the surface holds a previously rendered frame
 	struct wl_event_source *frame_timer;
 	int frame_delay; // ms
 };
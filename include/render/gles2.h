@@ -23,10 +23,32 @@ struct pixel_format {
 	GLuint *shader;
 };
 
+/**
+ * A run of queued vertices sharing the same texture (or color for colored
+ * quads) and scissor box, drawn with a single draw call.
+ */
+struct gles2_batch_draw {
+	struct wlr_texture *texture; // NULL for colored quads
+	float color[4];
+	bool scissor;
+	struct wlr_box scissor_box;
+	GLint first;
+	GLsizei count;
+};
+
 struct wlr_gles2_renderer {
 	struct wlr_renderer wlr_renderer;
 
 	struct wlr_egl *egl;
+	bool timer_query; // GL_EXT_disjoint_timer_query
+
+	int viewport_width, viewport_height;
+	bool scissor;
+	struct wlr_box scissor_box;
+
+	GLuint batch_vbo;
+	struct wl_array batch_vertices; // GLfloat x, y, u, v
+	struct wl_array batch_draws; // struct gles2_batch_draw
 };
 
 struct wlr_gles2_texture {
@@ -38,6 +60,27 @@ struct wlr_gles2_texture {
 	EGLImageKHR image;
 };
 
+/**
+ * Pixels copied out of a framebuffer into a texture, waiting for the GPU to
+ * complete the copy before they are read back.
+ */
+struct wlr_gles2_readback {
+	struct wlr_readback wlr_readback;
+
+	struct wlr_egl *egl;
+	const struct pixel_format *pixel_format;
+	uint32_t width, height;
+	GLuint tex_id;
+	EGLSyncKHR sync; // EGL_NO_SYNC_KHR once signaled, or if unsupported
+};
+
+struct wlr_gles2_render_timer {
+	struct wlr_render_timer wlr_render_timer;
+
+	GLuint query;
+	bool has_result; // the query has ended and its result wasn't read
+};
+
 struct shaders {
 	bool initialized;
 	GLuint rgba, rgbx;
@@ -51,6 +94,13 @@ extern struct shaders shaders;
 const struct pixel_format *gl_format_for_wl_format(enum wl_shm_format fmt);
 
 struct wlr_texture *gles2_texture_create();
+struct wlr_readback *gles2_readback_create(struct wlr_egl *egl,
+	const struct pixel_format *fmt, uint32_t width, uint32_t height,
+	uint32_t src_x, uint32_t src_y);
+struct wlr_render_timer *gles2_render_timer_create(void);
+bool gles2_read_pixels(const struct pixel_format *fmt, uint32_t stride,
+	uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+	uint32_t dst_x, uint32_t dst_y, void *data);
 
 extern const GLchar quad_vertex_src[];
 extern const GLchar quad_fragment_src[];
@@ -28,12 +28,29 @@ struct roots_device_config {
 	struct wl_list link;
 };
 
+#define ROOTS_CONFIG_BINDING_BUCKETS 256
+
+enum roots_binding_action {
+	ROOTS_BINDING_UNKNOWN,
+	ROOTS_BINDING_EXIT,
+	ROOTS_BINDING_CLOSE,
+	ROOTS_BINDING_FULLSCREEN,
+	ROOTS_BINDING_NEXT_WINDOW,
+	ROOTS_BINDING_EXEC,
+	ROOTS_BINDING_MAXIMIZE,
+	ROOTS_BINDING_NOP,
+	ROOTS_BINDING_TOGGLE_OUTPUTS,
+};
+
 struct roots_binding_config {
 	uint32_t modifiers;
-	xkb_keysym_t *keysyms;
+	xkb_keysym_t *keysyms; // sorted
 	size_t keysyms_len;
 	char *command;
+	enum roots_binding_action action;
+	const char *exec_cmd; // in command, only for ROOTS_BINDING_EXEC
 	struct wl_list link;
+	struct roots_binding_config *next; // in the same bucket
 };
 
 struct roots_keyboard_config {
@@ -55,15 +72,19 @@ struct roots_cursor_config {
 	struct wlr_box *mapped_box;
 	char *theme;
 	char *default_image;
+	bool coalesce_motion;
 	struct wl_list link;
 };
 
 struct roots_config {
 	bool xwayland;
+	bool xwayland_lazy;
 
 	struct wl_list outputs;
 	struct wl_list devices;
 	struct wl_list bindings;
+	// Bindings hashed by modifiers and keysyms, later bindings first
+	struct roots_binding_config *binding_table[ROOTS_CONFIG_BINDING_BUCKETS];
 	struct wl_list keyboards;
 	struct wl_list cursors;
 	char *config_path;
@@ -110,4 +131,12 @@ struct roots_keyboard_config *roots_config_get_keyboard(
 struct roots_cursor_config *roots_config_get_cursor(struct roots_config *config,
 	const char *seat_name);
 
+/**
+ * Get the binding triggered by the given modifiers and set of pressed keysyms.
+ * The keysyms must be sorted. If no binding matches, returns NULL.
+ */
+struct roots_binding_config *roots_config_get_binding(
+	struct roots_config *config, uint32_t modifiers,
+	const xkb_keysym_t *keysyms, size_t keysyms_len);
+
 #endif
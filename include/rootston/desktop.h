@@ -11,6 +11,7 @@
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_primary_selection.h>
+#include <wlr/types/wlr_screencast.h>
 #include <wlr/types/wlr_screenshooter.h>
 #include <wlr/types/wlr_wl_shell.h>
 #include <wlr/types/wlr_xcursor_manager.h>
@@ -19,8 +20,19 @@
 #include "rootston/output.h"
 #include "rootston/view.h"
 
+// Size of the cells of the view index, in layout coordinates
+#define ROOTS_VIEW_INDEX_CELL_SIZE 256
+#define ROOTS_VIEW_INDEX_BUCKETS 128
+// Views covering more cells are kept in a separate list
+#define ROOTS_VIEW_INDEX_MAX_CELLS 64
+
 struct roots_desktop {
-	struct wl_list views; // roots_view::link
+	struct wl_list views; // roots_view::link, topmost first
+	uint64_t view_stack_serial;
+
+	// Spatial index of the views, hashed by cell
+	struct wl_list view_index[ROOTS_VIEW_INDEX_BUCKETS]; // roots_view_index_entry::link
+	struct wl_list view_index_large; // roots_view_index_entry::link
 
 	struct wl_list outputs; // roots_output::link
 	struct timespec last_frame;
@@ -36,6 +48,7 @@ struct roots_desktop {
 	struct wlr_xdg_shell_v6 *xdg_shell_v6;
 	struct wlr_gamma_control_manager *gamma_control_manager;
 	struct wlr_screenshooter *screenshooter;
+	struct wlr_screencast_manager *screencast_manager;
 	struct wlr_server_decoration_manager *server_decoration_manager;
 	struct wlr_primary_selection_device_manager *primary_selection_device_manager;
 	struct wlr_idle *idle;
@@ -62,6 +75,11 @@ struct roots_output *desktop_output_from_wlr_output(
 	struct roots_desktop *desktop, struct wlr_output *output);
 struct roots_view *desktop_view_at(struct roots_desktop *desktop, double lx,
 	double ly, struct wlr_surface **surface, double *sx, double *sy);
+/**
+ * Inserts a view in the view list, above all the others.
+ */
+void desktop_insert_view(struct roots_desktop *desktop,
+	struct roots_view *view);
 
 void view_init(struct roots_view *view, struct roots_desktop *desktop);
 void view_finish(struct roots_view *view);
@@ -2,6 +2,7 @@
 #define ROOTSTON_SEAT_H
 
 #include <wayland-server.h>
+#include <wlr/types/wlr_scene.h>
 #include "rootston/input.h"
 #include "rootston/keyboard.h"
 
@@ -48,6 +49,7 @@ struct roots_drag_icon {
 	struct wl_list link;
 
 	double x, y;
+	struct wlr_scene_node *scene_node;
 
 	struct wl_listener surface_commit;
 	struct wl_listener map;
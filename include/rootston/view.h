@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <wlr/config.h>
 #include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/types/wlr_xdg_shell_v6.h>
 
@@ -59,9 +60,19 @@ enum roots_view_type {
 #endif
 };
 
+/**
+ * A cell of the desktop view index covered by a view.
+ */
+struct roots_view_index_entry {
+	struct roots_view *view;
+	int cell_x, cell_y;
+	struct wl_list link; // roots_desktop::view_index
+};
+
 struct roots_view {
 	struct roots_desktop *desktop;
 	struct wl_list link; // roots_desktop::views
+	uint64_t stack_serial; // higher is above
 
 	double x, y;
 	uint32_t width, height;
@@ -105,6 +116,19 @@ struct roots_view {
 	struct wlr_surface *wlr_surface;
 	struct wl_list children; // roots_view_child::link
 
+	// Scene graph of the view, see view_update_scene. The root node is at the
+	// view position and has the decorations and the surface as children.
+	struct wlr_scene_node *scene_node;
+	struct wlr_scene_node *deco_node;
+	struct wlr_scene_node *surface_node; // NULL if there is no surface
+
+	// Cells of the desktop view index covered by the view, empty if it isn't
+	// indexed, see desktop_view_at
+	struct wlr_box index_cells;
+	bool index_large; // in roots_desktop::view_index_large
+	struct roots_view_index_entry *index_entries;
+	size_t index_entries_len, index_entries_cap;
+
 	struct wl_listener new_subsurface;
 
 	struct {
@@ -130,6 +154,11 @@ struct roots_view_child {
 	struct wl_listener commit;
 	struct wl_listener new_subsurface;
 
+	// Only for popups, subsurfaces are part of their parent's node
+	struct wlr_scene_node *scene_node;
+	struct wl_listener scene_node_destroy;
+
+	void (*update_scene)(struct roots_view_child *child);
 	void (*destroy)(struct roots_view_child *child);
 };
 
@@ -168,6 +197,10 @@ void view_close(struct roots_view *view);
 bool view_center(struct roots_view *view);
 void view_setup(struct roots_view *view);
 void view_teardown(struct roots_view *view);
+/**
+ * Brings the view scene graph up-to-date with the view state.
+ */
+void view_update_scene(struct roots_view *view);
 
 void view_get_deco_box(const struct roots_view *view, struct wlr_box *box);
 
@@ -185,6 +218,12 @@ enum roots_deco_part view_get_deco_part(struct roots_view *view, double sx, doub
 void view_child_init(struct roots_view_child *child, struct roots_view *view,
 	struct wlr_surface *wlr_surface);
 void view_child_finish(struct roots_view_child *child);
+/**
+ * Creates a scene node for the child surface, above the other children of
+ * `parent`.
+ */
+void view_child_create_scene_node(struct roots_view_child *child,
+	struct wlr_scene_node *parent);
 
 struct roots_subsurface *subsurface_create(struct roots_view *view,
 	struct wlr_subsurface *wlr_subsurface);
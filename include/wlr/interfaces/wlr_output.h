@@ -6,6 +6,8 @@
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output.h>
 
+struct wlr_surface_buffer;
+
 struct wlr_output_impl {
 	void (*enable)(struct wlr_output *output, bool enable);
 	bool (*set_mode)(struct wlr_output *output, struct wlr_output_mode *mode);
@@ -20,6 +22,10 @@ struct wlr_output_impl {
 	void (*destroy)(struct wlr_output *output);
 	bool (*make_current)(struct wlr_output *output, int *buffer_age);
 	bool (*swap_buffers)(struct wlr_output *output, pixman_region32_t *damage);
+	bool (*scanout_buffer)(struct wlr_output *output,
+		struct wlr_surface_buffer *buffer);
+	bool (*set_overlay)(struct wlr_output *output,
+		struct wlr_surface_buffer *buffer, const struct wlr_box *box);
 	void (*set_gamma)(struct wlr_output *output,
 		uint32_t size, uint16_t *r, uint16_t *g, uint16_t *b);
 	uint32_t (*get_gamma_size)(struct wlr_output *output);
@@ -34,5 +40,11 @@ void wlr_output_update_custom_mode(struct wlr_output *output, int32_t width,
 void wlr_output_update_enabled(struct wlr_output *output, bool enabled);
 void wlr_output_update_needs_swap(struct wlr_output *output);
 void wlr_output_send_frame(struct wlr_output *output);
+/**
+ * Notifies the output that a frame has been presented at `when`, on the
+ * CLOCK_MONOTONIC clock, or now if `when` is NULL. The next frame event is
+ * delayed until just enough time is left to render before the next vblank.
+ */
+void wlr_output_send_present(struct wlr_output *output, struct timespec *when);
 
 #endif
@@ -44,6 +44,26 @@ bool wlr_render_with_matrix(struct wlr_renderer *r,
  */
 void wlr_render_colored_quad(struct wlr_renderer *r,
 	const float (*color)[4], const float (*matrix)[16]);
+/**
+ * Queues the texture for rendering using the provided matrix, clipped to the
+ * `clip` box (in renderer coordinates, like `wlr_renderer_scissor`). Providing
+ * a NULL `clip` box disables clipping.
+ *
+ * Queued quads are accumulated and drawn with as few draw calls as possible
+ * before the next non-queued rendering operation, or at the latest in
+ * `wlr_renderer_end`. Draw order is preserved. The texture must not be
+ * destroyed before then.
+ */
+bool wlr_render_with_matrix_clipped(struct wlr_renderer *r,
+	struct wlr_texture *texture, const float (*matrix)[16],
+	const struct wlr_box *clip);
+/**
+ * Queues a solid quad in the specified color, clipped to the `clip` box. See
+ * `wlr_render_with_matrix_clipped`.
+ */
+void wlr_render_colored_quad_clipped(struct wlr_renderer *r,
+	const float (*color)[4], const float (*matrix)[16],
+	const struct wlr_box *clip);
 /**
  * Renders a solid ellipse in the specified color.
  */
@@ -66,6 +86,19 @@ bool wlr_renderer_buffer_is_drm(struct wlr_renderer *renderer,
 bool wlr_renderer_read_pixels(struct wlr_renderer *r, enum wl_shm_format fmt,
 	uint32_t stride, uint32_t width, uint32_t height,
 	uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y, void *data);
+/**
+ * Starts reading out pixels of the currently bound surface without waiting for
+ * pending rendering to complete. Poll the returned readback with
+ * `wlr_readback_ready` and collect the pixels with `wlr_readback_finish`.
+ * Returns NULL if asynchronous readback isn't supported or failed.
+ */
+struct wlr_readback *wlr_renderer_read_pixels_async(struct wlr_renderer *r,
+	enum wl_shm_format fmt, uint32_t width, uint32_t height,
+	uint32_t src_x, uint32_t src_y);
+/**
+ * Returns the number of draw calls issued since the last `wlr_renderer_begin`.
+ */
+uint32_t wlr_renderer_get_draw_calls(struct wlr_renderer *r);
 /**
  * Checks if a format is supported.
  */
@@ -129,6 +162,13 @@ bool wlr_texture_upload_eglimage(struct wlr_texture *tex,
  */
 bool wlr_texture_update_shm(struct wlr_texture *surf, uint32_t format,
 		int x, int y, int width, int height, struct wl_shm_buffer *shm);
+/**
+ * Copies a region of pixels from a wl_shm_buffer onto the texture. Nearby
+ * rectangles may be merged so that the region is uploaded in fewer, larger
+ * copies. The same caveats as `wlr_texture_update_shm` apply.
+ */
+bool wlr_texture_update_shm_region(struct wlr_texture *tex, uint32_t format,
+		pixman_region32_t *region, struct wl_shm_buffer *shm);
 /**
  * Prepares a matrix with the appropriate scale for the given texture and
  * multiplies it with the projection, producing a matrix that the shader can
@@ -145,4 +185,58 @@ void wlr_texture_get_matrix(struct wlr_texture *texture,
  */
 void wlr_texture_destroy(struct wlr_texture *texture);
 
+struct wlr_readback_impl;
+
+struct wlr_readback {
+	struct wlr_readback_impl *impl;
+};
+
+/**
+ * Checks if the pixels of this readback are available, ie. if
+ * `wlr_readback_finish` won't stall waiting for the GPU.
+ */
+bool wlr_readback_ready(struct wlr_readback *readback);
+/**
+ * Copies the pixels of this readback into data, with the same layout as
+ * `wlr_renderer_read_pixels`. The renderer's context must be current. Blocks
+ * if the readback isn't ready yet.
+ */
+bool wlr_readback_finish(struct wlr_readback *readback, uint32_t stride,
+	uint32_t dst_x, uint32_t dst_y, void *data);
+/**
+ * Destroys this wlr_readback. The renderer's context must be current.
+ */
+void wlr_readback_destroy(struct wlr_readback *readback);
+
+struct wlr_render_timer_impl;
+
+struct wlr_render_timer {
+	struct wlr_render_timer_impl *impl;
+};
+
+/**
+ * Creates a timer measuring the time the GPU spends executing rendering
+ * commands. Returns NULL if the renderer doesn't support it.
+ */
+struct wlr_render_timer *wlr_render_timer_create(struct wlr_renderer *r);
+/**
+ * Starts measuring. Only one timer can be running at a time.
+ */
+void wlr_render_timer_begin(struct wlr_render_timer *timer);
+/**
+ * Stops measuring. The result becomes available once the GPU has executed the
+ * measured commands.
+ */
+void wlr_render_timer_end(struct wlr_render_timer *timer);
+/**
+ * Gets the measured GPU time in nanoseconds, or -1 if the measurement is
+ * invalid. Returns false if the result isn't available yet.
+ */
+bool wlr_render_timer_get_duration(struct wlr_render_timer *timer,
+	int64_t *duration);
+/**
+ * Destroys this wlr_render_timer.
+ */
+void wlr_render_timer_destroy(struct wlr_render_timer *timer);
+
 #endif
@@ -18,6 +18,7 @@ struct wlr_egl {
 	struct {
 		bool buffer_age;
 		bool swap_buffers_with_damage;
+		bool fence_sync;
 	} egl_exts;
 
 	struct wl_display *wl_display;
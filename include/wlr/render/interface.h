@@ -13,6 +13,8 @@ struct wlr_renderer_impl;
 
 struct wlr_renderer {
 	struct wlr_renderer_impl *impl;
+
+	uint32_t draw_calls; // since the last wlr_renderer_begin
 };
 
 struct wlr_renderer_impl {
@@ -27,6 +29,12 @@ struct wlr_renderer_impl {
 		const float (*color)[4], const float (*matrix)[16]);
 	void (*render_ellipse)(struct wlr_renderer *renderer,
 		const float (*color)[4], const float (*matrix)[16]);
+	bool (*render_texture_clipped)(struct wlr_renderer *renderer,
+		struct wlr_texture *texture, const float (*matrix)[16],
+		const struct wlr_box *clip);
+	void (*render_quad_clipped)(struct wlr_renderer *renderer,
+		const float (*color)[4], const float (*matrix)[16],
+		const struct wlr_box *clip);
 	const enum wl_shm_format *(*formats)(
 		struct wlr_renderer *renderer, size_t *len);
 	bool (*buffer_is_drm)(struct wlr_renderer *renderer,
@@ -35,6 +43,10 @@ struct wlr_renderer_impl {
 		uint32_t stride, uint32_t width, uint32_t height,
 		uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y,
 		void *data);
+	struct wlr_readback *(*read_pixels_async)(struct wlr_renderer *renderer,
+		enum wl_shm_format fmt, uint32_t width, uint32_t height,
+		uint32_t src_x, uint32_t src_y);
+	struct wlr_render_timer *(*timer_create)(struct wlr_renderer *renderer);
 	bool (*format_supported)(struct wlr_renderer *renderer,
 		enum wl_shm_format fmt);
 	void (*destroy)(struct wlr_renderer *renderer);
@@ -54,6 +66,8 @@ struct wlr_texture_impl {
 		struct wl_shm_buffer *shm);
 	bool (*update_shm)(struct wlr_texture *texture, uint32_t format,
 		int x, int y, int width, int height, struct wl_shm_buffer *shm);
+	bool (*update_shm_region)(struct wlr_texture *texture, uint32_t format,
+		pixman_region32_t *region, struct wl_shm_buffer *shm);
 	bool (*upload_drm)(struct wlr_texture *texture,
 		struct wl_resource *drm_buf);
 	bool (*upload_eglimage)(struct wlr_texture *texture, EGLImageKHR image,
@@ -72,4 +86,24 @@ void wlr_texture_bind(struct wlr_texture *texture);
 void wlr_texture_get_buffer_size(struct wlr_texture *texture,
 		struct wl_resource *resource, int *width, int *height);
 
+struct wlr_readback_impl {
+	bool (*ready)(struct wlr_readback *readback);
+	bool (*finish)(struct wlr_readback *readback, uint32_t stride,
+		uint32_t dst_x, uint32_t dst_y, void *data);
+	void (*destroy)(struct wlr_readback *readback);
+};
+
+void wlr_readback_init(struct wlr_readback *readback,
+		struct wlr_readback_impl *impl);
+
+struct wlr_render_timer_impl {
+	void (*begin)(struct wlr_render_timer *timer);
+	void (*end)(struct wlr_render_timer *timer);
+	bool (*get_duration)(struct wlr_render_timer *timer, int64_t *duration);
+	void (*destroy)(struct wlr_render_timer *timer);
+};
+
+void wlr_render_timer_init(struct wlr_render_timer *timer,
+		struct wlr_render_timer_impl *impl);
+
 #endif
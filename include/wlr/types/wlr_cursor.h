@@ -35,6 +35,17 @@ struct wlr_cursor *wlr_cursor_create();
 
 void wlr_cursor_destroy(struct wlr_cursor *cur);
 
+/**
+ * Coalesce relative pointer motion. Motion events received during an event
+ * loop iteration are merged and the motion signal is emitted once, when `loop`
+ * becomes idle, with the sum of their deltas. Other events flush pending
+ * motion first, so that ordering is preserved.
+ *
+ * Passing a NULL `loop` disables coalescing, which is the default.
+ */
+void wlr_cursor_set_motion_coalescing(struct wlr_cursor *cur,
+	struct wl_event_loop *loop);
+
 /**
  * Warp the cursor to the given x and y in layout coordinates. If x and y are
  * out of the layout boundaries or constraints, no warp will happen.
@@ -36,7 +36,30 @@ struct wlr_output_cursor {
 	} events;
 };
 
+/**
+ * Number of frames kept in the output frame timing history.
+ */
+#define WLR_OUTPUT_TIMING_LEN 64
+
+/**
+ * Statistics about a frame submitted to an output. Times are in nanoseconds,
+ * -1 if unknown. Some of them are only filled in after the frame has been
+ * presented.
+ */
+struct wlr_output_frame_timing {
+	uint64_t seq; // frame number, starting from 1
+	int64_t swap_time; // when the buffer swap completed, CLOCK_MONOTONIC
+	int64_t render_time; // CPU time from the frame event to the buffer swap
+	int64_t gpu_time; // GPU time spent rendering
+	int64_t present_latency; // from the buffer swap to presentation
+	uint32_t damage_area; // in buffer pixels
+	uint32_t draw_calls;
+	bool missed_vblank;
+	bool scanout; // whether a client buffer was scanned out directly
+};
+
 struct wlr_output_impl;
+struct wlr_render_timer;
 
 /**
  * A compositor output region. This typically corresponds to a monitor that
@@ -91,10 +114,40 @@ struct wlr_output {
 
 	struct wl_event_source *idle_frame;
 
+	// Frame scheduling, only used if the backend reports presentation times.
+	// Times are in nanoseconds on the CLOCK_MONOTONIC clock.
+	struct wl_event_source *frame_timer;
+	bool frame_timer_pending;
+	int64_t last_present; // zero if unknown
+	int64_t frame_target; // vblank the next frame is rendered for, or zero
+	int64_t frame_start; // time the last frame event was sent
+	int64_t render_time; // estimated time needed to render a frame
+	int64_t frame_margin; // safety margin between rendering and vblank
+	bool frame_emitting; // inside the frame event handlers
+
+	// Frame timing history, see wlr_output_get_frame_timings
+	struct wlr_output_frame_timing timings[WLR_OUTPUT_TIMING_LEN];
+	uint64_t timing_seq; // number of recorded frames
+	uint64_t present_seq; // frame waiting to be presented, or zero
+	// GPU timers for the current frame and for the previous one, whose result
+	// may not be available yet
+	struct wlr_render_timer *gpu_timers[2];
+	uint64_t gpu_timer_seq; // frame measured by gpu_timers[1], or zero
+	bool gpu_timer_running;
+	bool gpu_timer_unsupported;
+
 	struct wlr_surface *fullscreen_surface;
 	struct wl_listener fullscreen_surface_commit;
 	struct wl_listener fullscreen_surface_destroy;
 	int fullscreen_width, fullscreen_height;
+	// whether the fullscreen surface buffer was last scanned out directly
+	bool fullscreen_scanout;
+	// frames rendered since the last direct scanout, older renderer buffers
+	// are stale
+	int scanout_rendered_frames;
+	// client buffers are only displayed directly if there are no locks, see
+	// wlr_output_lock_direct_scanout
+	int direct_scanout_locks;
 
 	struct wl_list cursors; // wlr_output_cursor::link
 	struct wlr_output_cursor *hardware_cursor;
@@ -108,6 +161,7 @@ struct wlr_output {
 };
 
 struct wlr_surface;
+struct wlr_box;
 
 void wlr_output_enable(struct wlr_output *output, bool enable);
 void wlr_output_create_global(struct wlr_output *output);
@@ -135,7 +189,9 @@ void wlr_output_effective_resolution(struct wlr_output *output,
  * Makes the output rendering context current.
  *
  * `buffer_age` is set to the drawing buffer age in number of frames or -1 if
- * unknown. This is useful for damage tracking.
+ * unknown. This is useful for damage tracking. It is 0 for buffers last drawn
+ * before the output scanned out a client buffer directly, since other frames
+ * have been displayed since.
  */
 bool wlr_output_make_current(struct wlr_output *output, int *buffer_age);
 /**
@@ -144,6 +200,10 @@ bool wlr_output_make_current(struct wlr_output *output, int *buffer_age);
  * NULL.
  *
  * Swapping buffers schedules a `frame` event.
+ *
+ * The `swap_buffers` event is emitted once the frame, including the fullscreen
+ * surface and software cursors, is composited in the output buffer. It isn't
+ * emitted when the fullscreen surface buffer is scanned out directly.
  */
 bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 	pixman_region32_t *damage);
@@ -152,11 +212,37 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
  * it is a no-op.
  */
 void wlr_output_schedule_frame(struct wlr_output *output);
+/**
+ * Copies the timing statistics of the last frames into `timings`, most recent
+ * first. Returns the number of copied entries, at most `len`.
+ */
+size_t wlr_output_get_frame_timings(struct wlr_output *output,
+	struct wlr_output_frame_timing *timings, size_t len);
 void wlr_output_set_gamma(struct wlr_output *output,
 	uint32_t size, uint16_t *r, uint16_t *g, uint16_t *b);
 uint32_t wlr_output_get_gamma_size(struct wlr_output *output);
 void wlr_output_set_fullscreen_surface(struct wlr_output *output,
 	struct wlr_surface *surface);
+/**
+ * Displays the surface buffer on a hardware overlay plane, above the output
+ * buffer, starting from the next buffer swap. `box` is in output-local
+ * coordinates. Set `surface` to NULL to stop using the overlay plane.
+ *
+ * Returns false if the surface can't be displayed this way, in which case the
+ * overlay plane is disabled and the surface must be rendered as usual. The
+ * output buffer area below the overlay isn't displayed and needs to be
+ * repainted after the overlay plane is disabled.
+ */
+bool wlr_output_set_overlay_surface(struct wlr_output *output,
+	struct wlr_surface *surface, const struct wlr_box *box);
+/**
+ * Prevents the output from displaying client buffers directly, with fullscreen
+ * surface scanout or on the overlay plane, so that frames are entirely
+ * composited in the output buffer. This is needed to read frames back from
+ * the `swap_buffers` event. Calls with `lock` set to true and false must be
+ * balanced.
+ */
+void wlr_output_lock_direct_scanout(struct wlr_output *output, bool lock);
 
 
 struct wlr_output_cursor *wlr_output_cursor_create(struct wlr_output *output);
@@ -8,9 +8,19 @@
 /**
  * Damage tracking requires to keep track of previous frames' damage. To allow
  * damage tracking to work with triple buffering, a history of two frames is
- * required.
+ * required. The history grows up to the maximum length if the output hands out
+ * older buffers.
  */
 #define WLR_OUTPUT_DAMAGE_PREVIOUS_LEN 2
+#define WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN 8
+
+/**
+ * Default damage simplification cost model, see `wlr_region_simplify`.
+ * Rendering a damaged rectangle costs about as much as filling this many extra
+ * pixels.
+ */
+#define WLR_OUTPUT_DAMAGE_RECT_COST (64 * 64)
+#define WLR_OUTPUT_DAMAGE_MAX_RECTS 32
 
 /**
  * Tracks damage for an output.
@@ -25,9 +35,16 @@ struct wlr_output_damage {
 
 	pixman_region32_t current; // in output-local coordinates
 
-	// circular queue for previous damage
-	pixman_region32_t previous[WLR_OUTPUT_DAMAGE_PREVIOUS_LEN];
-	size_t previous_idx;
+	// circular queue for previous damage, accumulated: the nth most recent
+	// entry is the union of the damage of the last n frames
+	pixman_region32_t *previous;
+	size_t previous_len;
+	size_t previous_idx; // most recent entry
+
+	// Cost model used to simplify the damage before rendering, can be changed
+	// by the compositor. Setting `max_rects` to zero disables simplification.
+	int rect_cost; // in pixels
+	int max_rects;
 
 	struct {
 		struct wl_signal frame;
@@ -47,7 +64,8 @@ void wlr_output_damage_destroy(struct wlr_output_damage *output_damage);
 /**
  * Makes the output rendering context current. `needs_swap` is set to true if
  * `wlr_output_damage_swap_buffers` needs to be called. The region of the output
- * that needs to be repainted is added to `damage`.
+ * that needs to be repainted is added to `damage`. It is simplified according
+ * to the cost model so that it isn't made of too many rectangles.
  */
 bool wlr_output_damage_make_current(struct wlr_output_damage *output_damage,
 	bool *needs_swap, pixman_region32_t *damage);
@@ -0,0 +1,101 @@
+#ifndef WLR_TYPES_WLR_SCENE_H
+#define WLR_TYPES_WLR_SCENE_H
+
+#include <stdbool.h>
+#include <wayland-server.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_surface.h>
+
+/**
+ * A node of a retained scene graph. Nodes are drawn bottom to top, a node
+ * before its children.
+ *
+ * A node is positioned relative to its parent's top-left corner and rotates
+ * with its parent, around the parent's center. The resulting layout geometry
+ * is cached and only recomputed when the node or one of its ancestors changes.
+ * Changes are tracked up to the root, so that updating the tree only visits
+ * the subtrees containing them.
+ */
+struct wlr_scene_node {
+	struct wlr_scene_node *parent;
+	struct wl_list link; // wlr_scene_node::children
+	struct wl_list children; // wlr_scene_node::link, bottom to top
+
+	bool enabled;
+	double x, y; // relative to the parent, before rotation
+	int width, height;
+	float rotation; // added to the parent's rotation
+
+	// Surface displayed by this node, if any. The node size and the nodes of
+	// its subsurfaces are kept up-to-date with the surface state.
+	struct wlr_surface *surface;
+	// Only for nodes created for subsurfaces
+	struct wlr_subsurface *subsurface;
+
+	// Layout geometry, only valid after wlr_scene_node_update
+	struct {
+		double x, y; // top-left corner, before rotation
+		float rotation;
+		struct wlr_box bounds; // smallest box containing the rotated node
+		// smallest box containing the node and its enabled descendants
+		struct wlr_box subtree_bounds;
+	} layout;
+	bool dirty; // layout geometry needs to be recomputed
+	bool child_dirty; // a descendant needs to be updated
+
+	struct wl_listener surface_commit;
+	struct wl_listener surface_new_subsurface;
+	struct wl_listener surface_destroy;
+	struct wl_listener subsurface_destroy;
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+};
+
+typedef void (*wlr_scene_node_iterator_func_t)(struct wlr_scene_node *node,
+	void *data);
+
+/**
+ * Creates an empty node. If `parent` is NULL, the node is the root of a new
+ * tree. Otherwise, it is placed above its siblings.
+ */
+struct wlr_scene_node *wlr_scene_node_create(struct wlr_scene_node *parent);
+/**
+ * Creates a node displaying a surface, with child nodes for its subsurfaces.
+ */
+struct wlr_scene_node *wlr_scene_surface_create(struct wlr_scene_node *parent,
+	struct wlr_surface *surface);
+/**
+ * Destroys a node and all of its descendants.
+ */
+void wlr_scene_node_destroy(struct wlr_scene_node *node);
+
+void wlr_scene_node_set_enabled(struct wlr_scene_node *node, bool enabled);
+void wlr_scene_node_set_position(struct wlr_scene_node *node, double x,
+	double y);
+/**
+ * Sets the size of a node. The size of surface nodes follows their surface.
+ */
+void wlr_scene_node_set_size(struct wlr_scene_node *node, int width,
+	int height);
+void wlr_scene_node_set_rotation(struct wlr_scene_node *node, float rotation);
+
+/**
+ * Brings the layout geometry of a tree up-to-date. `node` must be the root of
+ * the tree.
+ */
+void wlr_scene_node_update(struct wlr_scene_node *node);
+
+/**
+ * Calls `iterator` on each enabled node whose bounds intersect `box`, bottom
+ * to top. Subtrees outside of `box` are skipped. If `box` is NULL, all enabled
+ * nodes are visited. The layout geometry must be up-to-date.
+ */
+void wlr_scene_node_for_each_in_box(struct wlr_scene_node *node,
+	const struct wlr_box *box, wlr_scene_node_iterator_func_t iterator,
+	void *data);
+
+#endif
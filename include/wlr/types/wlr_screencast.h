@@ -0,0 +1,59 @@
+#ifndef WLR_TYPES_WLR_SCREENCAST_H
+#define WLR_TYPES_WLR_SCREENCAST_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <wayland-server.h>
+
+struct wlr_screencast_manager {
+	struct wl_global *wl_global;
+	struct wl_list screencasts; // wlr_screencast::link
+
+	struct wl_listener display_destroy;
+
+	void *data;
+};
+
+struct wlr_screencast {
+	struct wl_resource *resource;
+	struct wlr_output *output;
+	struct wl_list link;
+
+	struct wl_list buffers; // wlr_screencast_buffer::link, oldest first
+	// Damage since the last captured frame, in buffer coordinates
+	pixman_region32_t damage;
+
+	// Frame being read back, NULL if none
+	struct wlr_screencast_buffer *capture_buffer;
+	pixman_region32_t capture_damage; // damage to send with the frame
+	struct wl_array readbacks; // struct screencast_readback
+	struct wl_event_source *readback_timer;
+
+	struct wl_listener output_swap_buffers;
+	struct wl_listener output_destroy;
+
+	void *data;
+};
+
+/**
+ * A client buffer known to a screencast. Buffers stay known after a frame has
+ * been exported to them, so that only stale pixels are copied once they are
+ * attached again.
+ */
+struct wlr_screencast_buffer {
+	struct wl_resource *resource;
+	struct wlr_screencast *screencast;
+	struct wl_list link;
+
+	bool attached;
+	// Pixels not up-to-date in this buffer, in buffer coordinates
+	pixman_region32_t damage;
+
+	struct wl_listener resource_destroy;
+};
+
+struct wlr_screencast_manager *wlr_screencast_manager_create(
+	struct wl_display *display);
+void wlr_screencast_manager_destroy(struct wlr_screencast_manager *manager);
+
+#endif
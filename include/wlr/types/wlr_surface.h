@@ -42,6 +42,18 @@ struct wlr_surface_state {
 	struct wl_list frame_callback_list; // wl_surface.frame
 };
 
+/**
+ * A client buffer which is used in place instead of being copied, for
+ * instance to be scanned out. The buffer is released to the client once the
+ * surface has moved on to another buffer and all references are dropped.
+ */
+struct wlr_surface_buffer {
+	struct wl_resource *resource; // NULL if destroyed by the client
+	size_t n_refs;
+
+	struct wl_listener resource_destroy;
+};
+
 struct wlr_subsurface {
 	struct wl_resource *resource;
 	struct wlr_surface *surface;
@@ -67,6 +79,8 @@ struct wlr_surface {
 	struct wl_resource *resource;
 	struct wlr_renderer *renderer;
 	struct wlr_texture *texture;
+	// Current buffer, only for buffers which aren't copied on commit
+	struct wlr_surface_buffer *buffer;
 	struct wlr_surface_state *current, *pending;
 	const char *role; // the lifetime-bound role or null
 
@@ -96,6 +110,14 @@ struct wlr_surface {
 	void *data;
 };
 
+/**
+ * Takes a reference to a surface buffer, which won't be released to the client
+ * until wlr_surface_buffer_unref is called.
+ */
+struct wlr_surface_buffer *wlr_surface_buffer_ref(
+	struct wlr_surface_buffer *buffer);
+void wlr_surface_buffer_unref(struct wlr_surface_buffer *buffer);
+
 struct wlr_renderer;
 struct wlr_surface *wlr_surface_create(struct wl_resource *res,
 		struct wlr_renderer *renderer);
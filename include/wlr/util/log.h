@@ -20,6 +20,15 @@ typedef void (*log_callback_t)(log_importance_t importance, const char *fmt, va_
 // If `callback` is NULL, wlr will use its default logger.
 void wlr_log_init(log_importance_t verbosity, log_callback_t callback);
 
+// Same as wlr_log_init with the default logger, but messages are written to
+// stderr by a background thread instead of the calling thread. Messages are
+// formatted and queued in a fixed-size ring buffer, they are dropped if it is
+// full. Messages still queued when the process crashes are lost.
+bool wlr_log_init_async(log_importance_t verbosity);
+// Writes all queued messages and goes back to logging synchronously. No other
+// thread may be logging at the same time.
+void wlr_log_finish_async(void);
+
 #ifdef __GNUC__
 #define ATTRIB_PRINTF(start, end) __attribute__((format(printf, start, end)))
 #else
@@ -30,11 +39,25 @@ void _wlr_log(log_importance_t verbosity, const char *format, ...) ATTRIB_PRINTF
 void _wlr_vlog(log_importance_t verbosity, const char *format, va_list args) ATTRIB_PRINTF(2, 0);
 const char *_strip_path(const char *filepath);
 
+extern log_importance_t _wlr_log_importance;
+
+// Messages above the verbosity are discarded before their arguments are
+// evaluated
 #define wlr_log(verb, fmt, ...) \
-	_wlr_log(verb, "[%s:%d] " fmt, _strip_path(__FILE__), __LINE__, ##__VA_ARGS__)
+	do { \
+		if ((verb) <= _wlr_log_importance) { \
+			_wlr_log(verb, "[%s:%d] " fmt, _strip_path(__FILE__), __LINE__, \
+				##__VA_ARGS__); \
+		} \
+	} while (0)
 
 #define wlr_vlog(verb, fmt, args) \
-	_wlr_vlog(verb, "[%s:%d] " fmt, _strip_path(__FILE__), __LINE__, args)
+	do { \
+		if ((verb) <= _wlr_log_importance) { \
+			_wlr_vlog(verb, "[%s:%d] " fmt, _strip_path(__FILE__), __LINE__, \
+				args); \
+		} \
+	} while (0)
 
 #define wlr_log_errno(verb, fmt, ...) \
 	wlr_log(verb, fmt ": %s", ##__VA_ARGS__, strerror(errno))
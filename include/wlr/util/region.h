@@ -26,4 +26,16 @@ void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
 void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
 	int distance);
 
+/**
+ * Simplifies a region so that it is made of fewer rectangles, at the cost of
+ * covering more pixels. `rect_cost` is the overhead of processing one more
+ * rectangle, expressed in pixels: rectangles are merged into their bounding box
+ * if it covers at most that many extra pixels. If more than `max_rects`
+ * rectangles are left, the region is replaced by its extents.
+ *
+ * The resulting region always contains the original one.
+ */
+void wlr_region_simplify(pixman_region32_t *dst, pixman_region32_t *src,
+	int rect_cost, int max_rects);
+
 #endif
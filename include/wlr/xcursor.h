@@ -50,14 +50,23 @@ struct wlr_xcursor {
 	uint32_t total_delay; /* length of the animation in ms */
 };
 
+struct wlr_xcursor_theme_entry;
+
 /**
  * Container for an Xcursor theme.
  */
 struct wlr_xcursor_theme {
 	unsigned int cursor_count;
-	struct wlr_xcursor **cursors;
+	struct wlr_xcursor **cursors; // cursors loaded so far
 	char *name;
 	int size;
+
+	// private state
+
+	// Index of the cursors of the theme by name, cursor files are only read
+	// when a cursor is first requested
+	struct wlr_xcursor_theme_entry **entries;
+	unsigned int entry_count;
 };
 
 /**
@@ -66,6 +75,9 @@ struct wlr_xcursor_theme {
  * client-side cursors is not available or you wish to override client-side
  * cursors for a particular UI interaction (such as using a grab cursor when
  * moving a window around).
+ *
+ * Only the list of cursors is read, each cursor is loaded the first time it is
+ * obtained with wlr_xcursor_theme_get_cursor.
  */
 struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size);
 
@@ -73,6 +85,8 @@ void wlr_xcursor_theme_destroy(struct wlr_xcursor_theme *theme);
 
 /**
  * Obtains a wlr_xcursor image for the specified cursor name (e.g. "left_ptr").
+ * If the theme file can't be decoded, the files of inherited themes are tried,
+ * then the built-in cursor with that name.
  */
 struct wlr_xcursor *wlr_xcursor_theme_get_cursor(
 	struct wlr_xcursor_theme *theme, const char *name);
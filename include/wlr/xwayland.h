@@ -25,6 +25,8 @@ struct wlr_xwayland {
 	time_t server_start;
 
 	struct wl_event_source *sigusr1_source;
+	// Only in lazy mode, while waiting for the first X11 client
+	struct wl_event_source *x_fd_read_event[2];
 	struct wl_listener client_destroy;
 	struct wl_listener display_destroy;
 	struct wlr_xwm *xwm;
@@ -34,6 +36,8 @@ struct wlr_xwayland {
 	struct wlr_seat *seat;
 	struct wl_listener seat_destroy;
 
+	bool lazy;
+
 	struct {
 		struct wl_signal ready;
 		struct wl_signal new_surface;
@@ -85,6 +89,7 @@ struct wlr_xwayland_surface {
 	uint32_t surface_id;
 
 	struct wl_list link;
+	struct wl_list window_link;
 	struct wl_list unpaired_link;
 
 	struct wlr_surface *surface;
@@ -94,6 +99,9 @@ struct wlr_xwayland_surface {
 	bool override_redirect;
 	bool mapped;
 	bool added;
+	// Waiting for property replies before emitting map_notify
+	bool map_pending;
+	size_t pending_properties;
 
 	char *title;
 	char *class;
@@ -160,8 +168,13 @@ struct wlr_xwayland_resize_event {
 	uint32_t edges;
 };
 
+/**
+ * Creates the X11 display. If `lazy` is true, the X11 sockets are bound and
+ * $DISPLAY is set right away, but Xwayland is only started when the first X11
+ * client connects. The ready event is emitted once Xwayland is running.
+ */
 struct wlr_xwayland *wlr_xwayland_create(struct wl_display *wl_display,
-	struct wlr_compositor *compositor);
+	struct wlr_compositor *compositor, bool lazy);
 
 void wlr_xwayland_destroy(struct wlr_xwayland *wlr_xwayland);
 
@@ -50,6 +50,9 @@ enum net_wm_state_action {
 	NET_WM_STATE_TOGGLE = 2,
 };
 
+// Number of buckets of the surface lookup tables, must be a power of two
+#define XWM_SURFACE_BUCKETS 256
+
 struct wlr_xwm_selection {
 	struct wlr_xwm *xwm;
 	xcb_atom_t atom;
@@ -57,15 +60,25 @@ struct wlr_xwm_selection {
 	xcb_selection_request_event_t request;
 	xcb_window_t owner;
 	xcb_timestamp_t timestamp;
-	int incr;
-	int source_fd;
-	int property_start;
-	xcb_get_property_reply_t *property_reply;
-	struct wl_event_source *property_source;
-	int flush_property_on_delete;
-	struct wl_array source_data;
+
+	// Wayland to X11 transfer
+	int incr; // transfer is incremental
+	int source_fd; // read end of the Wayland data source
+	struct wl_event_source *source_event_source;
+	struct wl_array source_data; // at most one chunk
+	bool source_eof;
 	xcb_atom_t target;
 	bool property_set;
+
+	// X11 to Wayland transfer
+	bool incoming_incr; // transfer is incremental
+	int target_fd; // write end of the Wayland data target
+	struct wl_event_source *target_event_source;
+	int property_start;
+	xcb_get_property_reply_t *property_reply;
+	// Property request waiting for a reply, see xwm_handle_selection_replies
+	bool property_pending;
+	xcb_get_property_cookie_t property_cookie;
 };
 
 struct wlr_xwm {
@@ -89,7 +102,12 @@ struct wlr_xwm {
 	struct wlr_xwayland_surface *focus_surface;
 
 	struct wl_list surfaces; // wlr_xwayland_surface::link
-	struct wl_list unpaired_surfaces; // wlr_xwayland_surface::unpaired_link
+	// Hash table keyed by window ID, wlr_xwayland_surface::window_link
+	struct wl_list surfaces_by_window[XWM_SURFACE_BUCKETS];
+	// Hash table keyed by surface ID, wlr_xwayland_surface::unpaired_link
+	struct wl_list unpaired_surfaces[XWM_SURFACE_BUCKETS];
+	// Property requests waiting for a reply, in request order
+	struct wl_list property_requests; // xwm_property_request::link
 
 	const xcb_query_extension_reply_t *xfixes;
 
@@ -106,6 +124,11 @@ void xwm_set_cursor(struct wlr_xwm *xwm, const uint8_t *pixels, uint32_t stride,
 	uint32_t width, uint32_t height, int32_t hotspot_x, int32_t hotspot_y);
 
 int xwm_handle_selection_event(struct wlr_xwm *xwm, xcb_generic_event_t *event);
+/**
+ * Collects the replies to selection property requests which have been
+ * received. Returns the number of replies handled.
+ */
+int xwm_handle_selection_replies(struct wlr_xwm *xwm);
 
 void xwm_selection_init(struct wlr_xwm *xwm);
 void xwm_selection_finish(struct wlr_xwm *xwm);
@@ -55,11 +55,14 @@ typedef struct _XcursorImages {
 XcursorImages *
 XcursorLibraryLoadImages (const char *file, const char *theme, int size);
 
+XcursorImages *
+XcursorFilenameLoadImages (const char *file, int size);
+
 void
 XcursorImagesDestroy (XcursorImages *images);
 
 void
-xcursor_load_theme(const char *theme, int size,
-		    void (*load_callback)(XcursorImages *, void *),
+xcursor_index_theme(const char *theme,
+		    void (*index_callback)(const char *, const char *, void *),
 		    void *user_data);
 #endif
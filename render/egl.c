@@ -146,6 +146,8 @@ bool wlr_egl_init(struct wlr_egl *egl, EGLenum platform, void *remote_display,
 	egl->egl_exts.swap_buffers_with_damage =
 		strstr(egl->egl_exts_str, "EGL_EXT_swap_buffers_with_damage") != NULL ||
 		strstr(egl->egl_exts_str, "EGL_KHR_swap_buffers_with_damage") != NULL;
+	egl->egl_exts.fence_sync =
+		strstr(egl->egl_exts_str, "EGL_KHR_fence_sync") != NULL;
 
 	return true;
 
@@ -0,0 +1,178 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/render.h>
+#include <wlr/render/egl.h>
+#include <wlr/render/interface.h>
+#include <wlr/util/log.h>
+#include "render/gles2.h"
+#include "glapi.h"
+
+bool gles2_read_pixels(const struct pixel_format *fmt, uint32_t stride,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y,
+		uint32_t dst_x, uint32_t dst_y, void *data) {
+	// GLES2 doesn't support GL_PACK_ROW_LENGTH, so glReadPixels can only
+	// write tightly packed rows. Read the whole rectangle in one go and fix
+	// up the stride and the upside-down row order on the CPU.
+	size_t row_len = width * fmt->bpp / 8;
+	unsigned char *p = (unsigned char *)data + dst_y * stride +
+		dst_x * fmt->bpp / 8;
+
+	if (stride == row_len) {
+		unsigned char *row = malloc(row_len);
+		if (row == NULL) {
+			wlr_log(L_ERROR, "Failed to allocate memory");
+			return false;
+		}
+		glReadPixels(src_x, src_y, width, height, fmt->gl_format,
+			fmt->gl_type, p);
+		for (size_t i = 0; i < height / 2; ++i) {
+			unsigned char *top = p + i * row_len;
+			unsigned char *bottom = p + (height - i - 1) * row_len;
+			memcpy(row, top, row_len);
+			memcpy(top, bottom, row_len);
+			memcpy(bottom, row, row_len);
+		}
+		free(row);
+	} else {
+		unsigned char *pixels = malloc(height * row_len);
+		if (pixels == NULL) {
+			wlr_log(L_ERROR, "Failed to allocate memory");
+			return false;
+		}
+		glReadPixels(src_x, src_y, width, height, fmt->gl_format,
+			fmt->gl_type, pixels);
+		for (size_t i = 0; i < height; ++i) {
+			memcpy(p + i * stride, pixels + (height - i - 1) * row_len,
+				row_len);
+		}
+		free(pixels);
+	}
+
+	return !gles2_flush_errors();
+}
+
+static bool gles2_readback_ready(struct wlr_readback *wlr_readback) {
+	struct wlr_gles2_readback *readback =
+		(struct wlr_gles2_readback *)wlr_readback;
+	if (readback->sync == EGL_NO_SYNC_KHR) {
+		return true;
+	}
+
+	EGLint ret = eglClientWaitSyncKHR(readback->egl->display, readback->sync,
+		0, 0);
+	if (ret == EGL_TIMEOUT_EXPIRED_KHR) {
+		return false;
+	}
+	// On error, report the readback as ready: finishing it will block but
+	// still return the right pixels
+	if (ret == EGL_FALSE) {
+		wlr_log(L_ERROR, "Failed to wait for readback fence");
+	}
+	eglDestroySyncKHR(readback->egl->display, readback->sync);
+	readback->sync = EGL_NO_SYNC_KHR;
+	return true;
+}
+
+static bool gles2_readback_finish(struct wlr_readback *wlr_readback,
+		uint32_t stride, uint32_t dst_x, uint32_t dst_y, void *data) {
+	struct wlr_gles2_readback *readback =
+		(struct wlr_gles2_readback *)wlr_readback;
+
+	GLint prev_fbo = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fbo);
+
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, readback->tex_id, 0);
+
+	bool ok = false;
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		wlr_log(L_ERROR, "Cannot read pixels: incomplete readback framebuffer");
+	} else {
+		ok = gles2_read_pixels(readback->pixel_format, stride,
+			readback->width, readback->height, 0, 0, dst_x, dst_y, data);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, prev_fbo);
+	glDeleteFramebuffers(1, &fbo);
+	return ok;
+}
+
+static void gles2_readback_destroy(struct wlr_readback *wlr_readback) {
+	struct wlr_gles2_readback *readback =
+		(struct wlr_gles2_readback *)wlr_readback;
+	if (readback->sync != EGL_NO_SYNC_KHR) {
+		eglDestroySyncKHR(readback->egl->display, readback->sync);
+	}
+	if (readback->tex_id != 0) {
+		glDeleteTextures(1, &readback->tex_id);
+	}
+	free(readback);
+}
+
+static struct wlr_readback_impl wlr_readback_impl = {
+	.ready = gles2_readback_ready,
+	.finish = gles2_readback_finish,
+	.destroy = gles2_readback_destroy,
+};
+
+struct wlr_readback *gles2_readback_create(struct wlr_egl *egl,
+		const struct pixel_format *fmt, uint32_t width, uint32_t height,
+		uint32_t src_x, uint32_t src_y) {
+	struct wlr_gles2_readback *readback =
+		calloc(1, sizeof(struct wlr_gles2_readback));
+	if (readback == NULL) {
+		wlr_log(L_ERROR, "Failed to allocate memory");
+		return NULL;
+	}
+	wlr_readback_init(&readback->wlr_readback, &wlr_readback_impl);
+	readback->egl = egl;
+	readback->pixel_format = fmt;
+	readback->width = width;
+	readback->height = height;
+	readback->sync = EGL_NO_SYNC_KHR;
+
+	// Copying to a texture with an alpha channel fails if the framebuffer
+	// has none
+	GLint alpha_bits = 0;
+	glGetIntegerv(GL_ALPHA_BITS, &alpha_bits);
+	GLenum internal_format = alpha_bits > 0 ? GL_RGBA : GL_RGB;
+
+	// GLES2 has no pixel buffer objects: copy the pixels to a texture instead,
+	// which is queued on the GPU like any other rendering command
+	glGenTextures(1, &readback->tex_id);
+	glBindTexture(GL_TEXTURE_2D, readback->tex_id);
+	glCopyTexImage2D(GL_TEXTURE_2D, 0, internal_format, src_x, src_y,
+		width, height, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (gles2_flush_errors()) {
+		wlr_log(L_ERROR, "Failed to copy pixels for readback");
+		gles2_readback_destroy(&readback->wlr_readback);
+		return NULL;
+	}
+
+	if (egl->egl_exts.fence_sync) {
+		readback->sync = eglCreateSyncKHR(egl->display, EGL_SYNC_FENCE_KHR,
+			NULL);
+		if (readback->sync == EGL_NO_SYNC_KHR) {
+			wlr_log(L_ERROR, "Failed to create readback fence");
+		}
+	}
+
+	if (readback->sync == EGL_NO_SYNC_KHR) {
+		// There is no way to tell when the copy completes, wait for it now
+		glFinish();
+	} else {
+		// Make sure the fence gets submitted, otherwise polling it never
+		// succeeds
+		glFlush();
+	}
+
+	return &readback->wlr_readback;
+}
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <wayland-server-protocol.h>
@@ -105,9 +106,80 @@ static void init_globals() {
 	init_default_shaders();
 }
 
+static void set_scissor(bool enabled, const struct wlr_box *box) {
+	if (enabled) {
+		glScissor(box->x, box->y, box->width, box->height);
+		glEnable(GL_SCISSOR_TEST);
+	} else {
+		glDisable(GL_SCISSOR_TEST);
+	}
+}
+
+/**
+ * Draws all quads queued by the clipped render functions. This must be called
+ * before any other operation touching the framebuffer, so that draw order is
+ * preserved.
+ */
+static void flush_batch(struct wlr_gles2_renderer *renderer) {
+	if (renderer->batch_draws.size == 0) {
+		return;
+	}
+
+	if (renderer->batch_vbo == 0) {
+		GL_CALL(glGenBuffers(1, &renderer->batch_vbo));
+	}
+	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, renderer->batch_vbo));
+	GL_CALL(glBufferData(GL_ARRAY_BUFFER, renderer->batch_vertices.size,
+		renderer->batch_vertices.data, GL_STREAM_DRAW));
+
+	GLsizei stride = 4 * sizeof(GLfloat);
+	GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride,
+		(const GLvoid *)0));
+	GL_CALL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+		(const GLvoid *)(2 * sizeof(GLfloat))));
+	GL_CALL(glEnableVertexAttribArray(0));
+	GL_CALL(glEnableVertexAttribArray(1));
+
+	// Vertices are already in normalized device coordinates
+	float identity[16];
+	wlr_matrix_identity(&identity);
+
+	struct gles2_batch_draw *draw;
+	wl_array_for_each(draw, &renderer->batch_draws) {
+		set_scissor(draw->scissor, &draw->scissor_box);
+		if (draw->texture != NULL) {
+			wlr_texture_bind(draw->texture);
+			GL_CALL(glUniformMatrix4fv(0, 1, GL_FALSE, identity));
+			GL_CALL(glUniform1f(2, 1.0f));
+		} else {
+			GL_CALL(glUseProgram(shaders.quad));
+			GL_CALL(glUniformMatrix4fv(0, 1, GL_FALSE, identity));
+			GL_CALL(glUniform4f(1, draw->color[0], draw->color[1],
+				draw->color[2], draw->color[3]));
+		}
+		GL_CALL(glDrawArrays(GL_TRIANGLES, draw->first, draw->count));
+		renderer->wlr_renderer.draw_calls++;
+	}
+
+	GL_CALL(glDisableVertexAttribArray(0));
+	GL_CALL(glDisableVertexAttribArray(1));
+	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+	// Restore the scissor box set by the user
+	set_scissor(renderer->scissor, &renderer->scissor_box);
+
+	renderer->batch_vertices.size = 0;
+	renderer->batch_draws.size = 0;
+}
+
 static void wlr_gles2_begin(struct wlr_renderer *wlr_renderer,
 		struct wlr_output *output) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+
 	GL_CALL(glViewport(0, 0, output->width, output->height));
+	renderer->viewport_width = output->width;
+	renderer->viewport_height = output->height;
 
 	// enable transparency
 	GL_CALL(glEnable(GL_BLEND));
@@ -118,23 +190,30 @@ static void wlr_gles2_begin(struct wlr_renderer *wlr_renderer,
 }
 
 static void wlr_gles2_end(struct wlr_renderer *wlr_renderer) {
-	// no-op
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	flush_batch(renderer);
 }
 
 static void wlr_gles2_clear(struct wlr_renderer *wlr_renderer,
 		const float (*color)[4]) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	flush_batch(renderer);
 	glClearColor((*color)[0], (*color)[1], (*color)[2], (*color)[3]);
 	glClear(GL_COLOR_BUFFER_BIT);
 }
 
 static void wlr_gles2_scissor(struct wlr_renderer *wlr_renderer,
 		struct wlr_box *box) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	flush_batch(renderer);
+	renderer->scissor = box != NULL;
 	if (box != NULL) {
-		glScissor(box->x, box->y, box->width, box->height);
-		glEnable(GL_SCISSOR_TEST);
-	} else {
-		glDisable(GL_SCISSOR_TEST);
+		renderer->scissor_box = *box;
 	}
+	set_scissor(renderer->scissor, &renderer->scissor_box);
 }
 
 static struct wlr_texture *wlr_gles2_texture_create(
@@ -144,7 +223,7 @@ static struct wlr_texture *wlr_gles2_texture_create(
 	return gles2_texture_create(renderer->egl);
 }
 
-static void draw_quad() {
+static void draw_quad(struct wlr_gles2_renderer *renderer) {
 	GLfloat verts[] = {
 		1, 0, // top right
 		0, 0, // top left
@@ -165,6 +244,7 @@ static void draw_quad() {
 	GL_CALL(glEnableVertexAttribArray(1));
 
 	GL_CALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+	renderer->wlr_renderer.draw_calls++;
 
 	GL_CALL(glDisableVertexAttribArray(0));
 	GL_CALL(glDisableVertexAttribArray(1));
@@ -172,33 +252,172 @@ static void draw_quad() {
 
 static bool wlr_gles2_render_texture(struct wlr_renderer *wlr_renderer,
 		struct wlr_texture *texture, const float (*matrix)[16]) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
 	if (!texture || !texture->valid) {
 		wlr_log(L_ERROR, "attempt to render invalid texture");
 		return false;
 	}
 
+	flush_batch(renderer);
 	wlr_texture_bind(texture);
 	GL_CALL(glUniformMatrix4fv(0, 1, GL_FALSE, *matrix));
 	// TODO: source alpha from somewhere else I guess
 	GL_CALL(glUniform1f(2, 1.0f));
-	draw_quad();
+	draw_quad(renderer);
 	return true;
 }
 
 static void wlr_gles2_render_quad(struct wlr_renderer *wlr_renderer,
 		const float (*color)[4], const float (*matrix)[16]) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	flush_batch(renderer);
 	GL_CALL(glUseProgram(shaders.quad));
 	GL_CALL(glUniformMatrix4fv(0, 1, GL_FALSE, *matrix));
 	GL_CALL(glUniform4f(1, (*color)[0], (*color)[1], (*color)[2], (*color)[3]));
-	draw_quad();
+	draw_quad(renderer);
 }
 
 static void wlr_gles2_render_ellipse(struct wlr_renderer *wlr_renderer,
 		const float (*color)[4], const float (*matrix)[16]) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	flush_batch(renderer);
 	GL_CALL(glUseProgram(shaders.ellipse));
 	GL_CALL(glUniformMatrix4fv(0, 1, GL_TRUE, *matrix));
 	GL_CALL(glUniform4f(1, (*color)[0], (*color)[1], (*color)[2], (*color)[3]));
-	draw_quad();
+	draw_quad(renderer);
+}
+
+/**
+ * Queues a quad mapping the unit square through `matrix`, clipped to `clip`
+ * (in renderer coordinates). If the quad is axis-aligned, it is clipped on the
+ * CPU and its texture coordinates are adjusted accordingly. Otherwise the clip
+ * box is kept as a scissor box for its draw call.
+ */
+static bool queue_quad(struct wlr_gles2_renderer *renderer,
+		struct wlr_texture *texture, const float (*color)[4],
+		const float (*matrix)[16], const struct wlr_box *clip) {
+	float w = renderer->viewport_width;
+	float h = renderer->viewport_height;
+	const float *m = *matrix;
+
+	// Affine map from the unit square to renderer coordinates:
+	// x = a*u + b*v + c, y = d*u + e*v + f
+	float a = m[0] * w / 2, b = m[1] * w / 2, c = (m[3] + 1) * w / 2;
+	float d = m[4] * h / 2, e = m[5] * h / 2, f = (m[7] + 1) * h / 2;
+	float det = a * e - b * d;
+	if (det == 0) {
+		return true;
+	}
+
+	static const float unit[4][2] = { {0, 0}, {1, 0}, {0, 1}, {1, 1} };
+	float x[4], y[4], u[4], v[4];
+	for (int i = 0; i < 4; ++i) {
+		u[i] = unit[i][0];
+		v[i] = unit[i][1];
+		x[i] = a * u[i] + b * v[i] + c;
+		y[i] = d * u[i] + e * v[i] + f;
+	}
+
+	bool scissor = false;
+	if (clip != NULL && ((b == 0 && d == 0) || (a == 0 && e == 0))) {
+		float x1 = fmaxf(fminf(x[0], x[3]), clip->x);
+		float x2 = fminf(fmaxf(x[0], x[3]), clip->x + clip->width);
+		float y1 = fmaxf(fminf(y[0], y[3]), clip->y);
+		float y2 = fminf(fmaxf(y[0], y[3]), clip->y + clip->height);
+		if (x1 >= x2 || y1 >= y2) {
+			return true;
+		}
+
+		float clipped[4][2] = { {x1, y1}, {x2, y1}, {x1, y2}, {x2, y2} };
+		for (int i = 0; i < 4; ++i) {
+			x[i] = clipped[i][0];
+			y[i] = clipped[i][1];
+			// Invert the affine map to get the texture coordinates
+			u[i] = (e * (x[i] - c) - b * (y[i] - f)) / det;
+			v[i] = (a * (y[i] - f) - d * (x[i] - c)) / det;
+		}
+	} else if (clip != NULL) {
+		scissor = true;
+	}
+
+	// Two triangles per quad, so that batched quads needn't be contiguous
+	static const int indices[] = { 0, 1, 2, 2, 1, 3 };
+	size_t nverts = sizeof(indices) / sizeof(indices[0]);
+	GLfloat *verts = wl_array_add(&renderer->batch_vertices,
+		nverts * 4 * sizeof(GLfloat));
+	if (verts == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return false;
+	}
+	for (size_t i = 0; i < nverts; ++i) {
+		int j = indices[i];
+		verts[4*i] = x[j] * 2 / w - 1;
+		verts[4*i + 1] = y[j] * 2 / h - 1;
+		verts[4*i + 2] = u[j];
+		verts[4*i + 3] = v[j];
+	}
+	GLint first = renderer->batch_vertices.size / (4 * sizeof(GLfloat)) -
+		nverts;
+
+	// Extend the previous draw call if the state doesn't change
+	size_t ndraws =
+		renderer->batch_draws.size / sizeof(struct gles2_batch_draw);
+	if (ndraws > 0) {
+		struct gles2_batch_draw *last =
+			&((struct gles2_batch_draw *)renderer->batch_draws.data)[ndraws - 1];
+		bool same_scissor = last->scissor == scissor && (!scissor ||
+			memcmp(&last->scissor_box, clip, sizeof(*clip)) == 0);
+		bool same_color = texture != NULL ||
+			memcmp(last->color, *color, sizeof(last->color)) == 0;
+		if (last->texture == texture && same_color && same_scissor) {
+			last->count += nverts;
+			return true;
+		}
+	}
+
+	struct gles2_batch_draw *draw = wl_array_add(&renderer->batch_draws,
+		sizeof(struct gles2_batch_draw));
+	if (draw == NULL) {
+		renderer->batch_vertices.size -= nverts * 4 * sizeof(GLfloat);
+		wlr_log(L_ERROR, "Allocation failed");
+		return false;
+	}
+	memset(draw, 0, sizeof(*draw));
+	draw->texture = texture;
+	if (color != NULL) {
+		memcpy(draw->color, *color, sizeof(draw->color));
+	}
+	draw->scissor = scissor;
+	if (scissor) {
+		draw->scissor_box = *clip;
+	}
+	draw->first = first;
+	draw->count = nverts;
+	return true;
+}
+
+static bool wlr_gles2_render_texture_clipped(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *texture,
+		const float (*matrix)[16], const struct wlr_box *clip) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	if (!texture || !texture->valid) {
+		wlr_log(L_ERROR, "attempt to render invalid texture");
+		return false;
+	}
+
+	return queue_quad(renderer, texture, NULL, matrix, clip);
+}
+
+static void wlr_gles2_render_quad_clipped(struct wlr_renderer *wlr_renderer,
+		const float (*color)[4], const float (*matrix)[16],
+		const struct wlr_box *clip) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	queue_quad(renderer, NULL, color, matrix, clip);
 }
 
 static const enum wl_shm_format *wlr_gles2_formats(
@@ -222,28 +441,50 @@ static bool wlr_gles2_buffer_is_drm(struct wlr_renderer *wlr_renderer,
 		EGL_TEXTURE_FORMAT, &format);
 }
 
-static bool wlr_gles2_read_pixels(struct wlr_renderer *renderer,
+static bool wlr_gles2_read_pixels(struct wlr_renderer *wlr_renderer,
 		enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width,
 		uint32_t height, uint32_t src_x, uint32_t src_y, uint32_t dst_x,
 		uint32_t dst_y, void *data) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	flush_batch(renderer);
+
 	const struct pixel_format *fmt = gl_format_for_wl_format(wl_fmt);
 	if (fmt == NULL) {
 		wlr_log(L_ERROR, "Cannot read pixels: unsupported pixel format");
 		return false;
 	}
 
-	// Make sure any pending drawing is finished before we try to read it
-	glFinish();
+	// glReadPixels waits for any pending drawing to finish
+	return gles2_read_pixels(fmt, stride, width, height, src_x, src_y,
+		dst_x, dst_y, data);
+}
 
-	// Unfortunately GLES2 doesn't support GL_PACK_*, so we have to read
-	// the lines out row by row
-	unsigned char *p = data + dst_y * stride;
-	for (size_t i = src_y; i < src_y + height; ++i) {
-		glReadPixels(src_x, src_y + height - i - 1, width, 1, fmt->gl_format,
-			fmt->gl_type, p + i * stride + dst_x * fmt->bpp / 8);
+static struct wlr_readback *wlr_gles2_read_pixels_async(
+		struct wlr_renderer *wlr_renderer, enum wl_shm_format wl_fmt,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	flush_batch(renderer);
+
+	const struct pixel_format *fmt = gl_format_for_wl_format(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(L_ERROR, "Cannot read pixels: unsupported pixel format");
+		return NULL;
 	}
 
-	return true;
+	return gles2_readback_create(renderer->egl, fmt, width, height,
+		src_x, src_y);
+}
+
+static struct wlr_render_timer *wlr_gles2_timer_create(
+		struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	if (!renderer->timer_query) {
+		return NULL;
+	}
+	return gles2_render_timer_create();
 }
 
 static bool wlr_gles2_format_supported(struct wlr_renderer *r,
@@ -251,6 +492,17 @@ static bool wlr_gles2_format_supported(struct wlr_renderer *r,
 	return gl_format_for_wl_format(wl_fmt);
 }
 
+static void wlr_gles2_destroy(struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		(struct wlr_gles2_renderer *)wlr_renderer;
+	if (renderer->batch_vbo != 0) {
+		glDeleteBuffers(1, &renderer->batch_vbo);
+	}
+	wl_array_release(&renderer->batch_vertices);
+	wl_array_release(&renderer->batch_draws);
+	free(renderer);
+}
+
 static struct wlr_renderer_impl wlr_renderer_impl = {
 	.begin = wlr_gles2_begin,
 	.end = wlr_gles2_end,
@@ -260,10 +512,15 @@ static struct wlr_renderer_impl wlr_renderer_impl = {
 	.render_with_matrix = wlr_gles2_render_texture,
 	.render_quad = wlr_gles2_render_quad,
 	.render_ellipse = wlr_gles2_render_ellipse,
+	.render_texture_clipped = wlr_gles2_render_texture_clipped,
+	.render_quad_clipped = wlr_gles2_render_quad_clipped,
 	.formats = wlr_gles2_formats,
 	.buffer_is_drm = wlr_gles2_buffer_is_drm,
 	.read_pixels = wlr_gles2_read_pixels,
+	.read_pixels_async = wlr_gles2_read_pixels_async,
+	.timer_create = wlr_gles2_timer_create,
 	.format_supported = wlr_gles2_format_supported,
+	.destroy = wlr_gles2_destroy,
 };
 
 struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_backend *backend) {
@@ -273,8 +530,14 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_backend *backend) {
 		return NULL;
 	}
 	wlr_renderer_init(&renderer->wlr_renderer, &wlr_renderer_impl);
+	wl_array_init(&renderer->batch_vertices);
+	wl_array_init(&renderer->batch_draws);
 
 	renderer->egl = wlr_backend_get_egl(backend);
+	renderer->timer_query = renderer->egl != NULL &&
+		strstr(renderer->egl->gl_exts_str, "GL_EXT_disjoint_timer_query") &&
+		glGenQueriesEXT && glDeleteQueriesEXT && glBeginQueryEXT &&
+		glEndQueryEXT && glGetQueryObjectuivEXT && glGetQueryObjectui64vEXT;
 
 	return &renderer->wlr_renderer;
 }
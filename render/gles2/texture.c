@@ -10,6 +10,7 @@
 #include <wlr/render/interface.h>
 #include <wlr/render/matrix.h>
 #include <wlr/util/log.h>
+#include <wlr/util/region.h>
 #include "render/gles2.h"
 #include "util/signal.h"
 
@@ -143,6 +144,58 @@ static bool gles2_texture_update_shm(struct wlr_texture *_texture,
 	return true;
 }
 
+// Each glTexSubImage2D call costs about as much as uploading this many extra
+// pixels
+#define UPLOAD_RECT_COST (64 * 64)
+// Above this many rectangles, the region extents are uploaded at once
+#define UPLOAD_MAX_RECTS 64
+
+static bool gles2_texture_update_shm_region(struct wlr_texture *_texture,
+		uint32_t format, pixman_region32_t *region,
+		struct wl_shm_buffer *buffer) {
+	struct wlr_gles2_texture *texture = (struct wlr_gles2_texture *)_texture;
+	assert(texture);
+	if (!texture->wlr_texture.valid
+			|| texture->wlr_texture.format != format) {
+		return gles2_texture_upload_shm(&texture->wlr_texture, format, buffer);
+	}
+
+	if (!pixman_region32_not_empty(region)) {
+		return true;
+	}
+
+	// Merge rectangles so that fewer uploads are needed
+	pixman_region32_t simplified;
+	pixman_region32_init(&simplified);
+	wlr_region_simplify(&simplified, region, UPLOAD_RECT_COST,
+		UPLOAD_MAX_RECTS);
+	int n;
+	pixman_box32_t *rects = pixman_region32_rectangles(&simplified, &n);
+
+	const struct pixel_format *fmt = texture->pixel_format;
+	wl_shm_buffer_begin_access(buffer);
+	uint8_t *pixels = wl_shm_buffer_get_data(buffer);
+	int pitch = wl_shm_buffer_get_stride(buffer) / (fmt->bpp / 8);
+
+	GL_CALL(glBindTexture(GL_TEXTURE_2D, texture->tex_id));
+	GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, pitch));
+	for (int i = 0; i < n; ++i) {
+		pixman_box32_t *rect = &rects[i];
+		GL_CALL(glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, rect->x1));
+		GL_CALL(glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, rect->y1));
+		GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, rect->x1, rect->y1,
+			rect->x2 - rect->x1, rect->y2 - rect->y1,
+			fmt->gl_format, fmt->gl_type, pixels));
+	}
+	GL_CALL(glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0));
+	GL_CALL(glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0));
+
+	wl_shm_buffer_end_access(buffer);
+	pixman_region32_fini(&simplified);
+
+	return true;
+}
+
 static bool gles2_texture_upload_drm(struct wlr_texture *_tex,
 		struct wl_resource *buf) {
 	struct wlr_gles2_texture *tex = (struct wlr_gles2_texture *)_tex;
@@ -289,6 +342,7 @@ static struct wlr_texture_impl wlr_texture_impl = {
 	.update_pixels = gles2_texture_update_pixels,
 	.upload_shm = gles2_texture_upload_shm,
 	.update_shm = gles2_texture_update_shm,
+	.update_shm_region = gles2_texture_update_shm_region,
 	.upload_drm = gles2_texture_upload_drm,
 	.upload_eglimage = gles2_texture_upload_eglimage,
 	.get_matrix = gles2_texture_get_matrix,
@@ -0,0 +1,77 @@
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <wlr/render.h>
+#include <wlr/render/interface.h>
+#include <wlr/util/log.h>
+#include "render/gles2.h"
+#include "glapi.h"
+
+static void gles2_render_timer_begin(struct wlr_render_timer *wlr_timer) {
+	struct wlr_gles2_render_timer *timer =
+		(struct wlr_gles2_render_timer *)wlr_timer;
+	GL_CALL(glBeginQueryEXT(GL_TIME_ELAPSED_EXT, timer->query));
+	timer->has_result = false;
+}
+
+static void gles2_render_timer_end(struct wlr_render_timer *wlr_timer) {
+	struct wlr_gles2_render_timer *timer =
+		(struct wlr_gles2_render_timer *)wlr_timer;
+	GL_CALL(glEndQueryEXT(GL_TIME_ELAPSED_EXT));
+	timer->has_result = true;
+}
+
+static bool gles2_render_timer_get_duration(struct wlr_render_timer *wlr_timer,
+		int64_t *duration) {
+	struct wlr_gles2_render_timer *timer =
+		(struct wlr_gles2_render_timer *)wlr_timer;
+	if (!timer->has_result) {
+		return false;
+	}
+
+	GLuint available = GL_FALSE;
+	GL_CALL(glGetQueryObjectuivEXT(timer->query,
+		GL_QUERY_RESULT_AVAILABLE_EXT, &available));
+	if (!available) {
+		return false;
+	}
+
+	GLuint64 elapsed = 0;
+	GL_CALL(glGetQueryObjectui64vEXT(timer->query, GL_QUERY_RESULT_EXT,
+		&elapsed));
+	timer->has_result = false;
+
+	// The GPU clock may have been reset (e.g. after a frequency change), in
+	// which case the result is meaningless
+	GLint disjoint = GL_FALSE;
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+	*duration = disjoint ? -1 : (int64_t)elapsed;
+	return true;
+}
+
+static void gles2_render_timer_destroy(struct wlr_render_timer *wlr_timer) {
+	struct wlr_gles2_render_timer *timer =
+		(struct wlr_gles2_render_timer *)wlr_timer;
+	glDeleteQueriesEXT(1, &timer->query);
+	free(timer);
+}
+
+static struct wlr_render_timer_impl wlr_render_timer_impl = {
+	.begin = gles2_render_timer_begin,
+	.end = gles2_render_timer_end,
+	.get_duration = gles2_render_timer_get_duration,
+	.destroy = gles2_render_timer_destroy,
+};
+
+struct wlr_render_timer *gles2_render_timer_create(void) {
+	struct wlr_gles2_render_timer *timer =
+		calloc(1, sizeof(struct wlr_gles2_render_timer));
+	if (timer == NULL) {
+		wlr_log(L_ERROR, "Failed to allocate memory");
+		return NULL;
+	}
+	wlr_render_timer_init(&timer->wlr_render_timer, &wlr_render_timer_impl);
+	GL_CALL(glGenQueriesEXT(1, &timer->query));
+	return &timer->wlr_render_timer;
+}
@@ -45,43 +45,17 @@ void wlr_matrix_rotate(float (*output)[16], float radians) {
 }
 
 void wlr_matrix_mul(const float (*x)[16], const float (*y)[16], float (*product)[16]) {
-	float _product[16] = {
-		(*x)[mind(1, 1)] * (*y)[mind(1, 1)] + (*x)[mind(1, 2)] * (*y)[mind(2, 1)] +
-			(*x)[mind(1, 3)] * (*y)[mind(3, 1)] + (*x)[mind(1, 4)] * (*y)[mind(4, 1)],
-		(*x)[mind(1, 1)] * (*y)[mind(1, 2)] + (*x)[mind(1, 2)] * (*y)[mind(2, 2)] +
-			(*x)[mind(1, 3)] * (*y)[mind(3, 2)] + (*x)[mind(1, 4)] * (*y)[mind(4, 2)],
-		(*x)[mind(1, 1)] * (*y)[mind(1, 3)] + (*x)[mind(1, 2)] * (*y)[mind(2, 3)] +
-			(*x)[mind(1, 3)] * (*y)[mind(3, 3)] + (*x)[mind(1, 4)] * (*y)[mind(4, 3)],
-		(*x)[mind(1, 1)] * (*y)[mind(1, 4)] + (*x)[mind(1, 2)] * (*y)[mind(2, 4)] +
-			(*x)[mind(1, 4)] * (*y)[mind(3, 4)] + (*x)[mind(1, 4)] * (*y)[mind(4, 4)],
-
-		(*x)[mind(2, 1)] * (*y)[mind(1, 1)] + (*x)[mind(2, 2)] * (*y)[mind(2, 1)] +
-			(*x)[mind(2, 3)] * (*y)[mind(3, 1)] + (*x)[mind(2, 4)] * (*y)[mind(4, 1)],
-		(*x)[mind(2, 1)] * (*y)[mind(1, 2)] + (*x)[mind(2, 2)] * (*y)[mind(2, 2)] +
-			(*x)[mind(2, 3)] * (*y)[mind(3, 2)] + (*x)[mind(2, 4)] * (*y)[mind(4, 2)],
-		(*x)[mind(2, 1)] * (*y)[mind(1, 3)] + (*x)[mind(2, 2)] * (*y)[mind(2, 3)] +
-			(*x)[mind(2, 3)] * (*y)[mind(3, 3)] + (*x)[mind(2, 4)] * (*y)[mind(4, 3)],
-		(*x)[mind(2, 1)] * (*y)[mind(1, 4)] + (*x)[mind(2, 2)] * (*y)[mind(2, 4)] +
-			(*x)[mind(2, 4)] * (*y)[mind(3, 4)] + (*x)[mind(2, 4)] * (*y)[mind(4, 4)],
-
-		(*x)[mind(3, 1)] * (*y)[mind(1, 1)] + (*x)[mind(3, 2)] * (*y)[mind(2, 1)] +
-			(*x)[mind(3, 3)] * (*y)[mind(3, 1)] + (*x)[mind(3, 4)] * (*y)[mind(4, 1)],
-		(*x)[mind(3, 1)] * (*y)[mind(1, 2)] + (*x)[mind(3, 2)] * (*y)[mind(2, 2)] +
-			(*x)[mind(3, 3)] * (*y)[mind(3, 2)] + (*x)[mind(3, 4)] * (*y)[mind(4, 2)],
-		(*x)[mind(3, 1)] * (*y)[mind(1, 3)] + (*x)[mind(3, 2)] * (*y)[mind(2, 3)] +
-			(*x)[mind(3, 3)] * (*y)[mind(3, 3)] + (*x)[mind(3, 4)] * (*y)[mind(4, 3)],
-		(*x)[mind(3, 1)] * (*y)[mind(1, 4)] + (*x)[mind(3, 2)] * (*y)[mind(2, 4)] +
-			(*x)[mind(3, 4)] * (*y)[mind(3, 4)] + (*x)[mind(3, 4)] * (*y)[mind(4, 4)],
-
-		(*x)[mind(4, 1)] * (*y)[mind(1, 1)] + (*x)[mind(4, 2)] * (*y)[mind(2, 1)] +
-			(*x)[mind(4, 3)] * (*y)[mind(3, 1)] + (*x)[mind(4, 4)] * (*y)[mind(4, 1)],
-		(*x)[mind(4, 1)] * (*y)[mind(1, 2)] + (*x)[mind(4, 2)] * (*y)[mind(2, 2)] +
-			(*x)[mind(4, 3)] * (*y)[mind(3, 2)] + (*x)[mind(4, 4)] * (*y)[mind(4, 2)],
-		(*x)[mind(4, 1)] * (*y)[mind(1, 3)] + (*x)[mind(4, 2)] * (*y)[mind(2, 3)] +
-			(*x)[mind(4, 3)] * (*y)[mind(3, 3)] + (*x)[mind(4, 4)] * (*y)[mind(4, 3)],
-		(*x)[mind(4, 1)] * (*y)[mind(1, 4)] + (*x)[mind(4, 2)] * (*y)[mind(2, 4)] +
-			(*x)[mind(4, 4)] * (*y)[mind(3, 4)] + (*x)[mind(4, 4)] * (*y)[mind(4, 4)],
-	};
+	// Each row of the product is a linear combination of the rows of y. This
+	// form is easy for compilers to vectorize.
+	float _product[16];
+	for (int i = 0; i < 4; ++i) {
+		const float *xr = &(*x)[4 * i];
+		float *pr = &_product[4 * i];
+		for (int j = 0; j < 4; ++j) {
+			pr[j] = xr[0] * (*y)[j] + xr[1] * (*y)[4 + j] +
+				xr[2] * (*y)[8 + j] + xr[3] * (*y)[12 + j];
+		}
+	}
 	memcpy(*product, _product, sizeof(_product));
 }
 
@@ -161,6 +135,37 @@ void wlr_matrix_texture(float mat[static 16], int32_t width, int32_t height,
 	mat[15] = 1.0f;
 }
 
+/**
+ * Multiplies two 2D affine transformations, stored as the first two rows of a
+ * 3x3 matrix.
+ */
+static void affine_mul(const float x[static 6], const float y[static 6],
+		float product[static 6]) {
+	float _product[6] = {
+		x[0] * y[0] + x[1] * y[3],
+		x[0] * y[1] + x[1] * y[4],
+		x[0] * y[2] + x[1] * y[5] + x[2],
+		x[3] * y[0] + x[4] * y[3],
+		x[3] * y[1] + x[4] * y[4],
+		x[3] * y[2] + x[4] * y[5] + x[5],
+	};
+	memcpy(product, _product, sizeof(_product));
+}
+
+/**
+ * Builds the 2D affine transformation applying the 2x2 matrix `m` around the
+ * point (cx, cy).
+ */
+static void affine_around(float affine[static 6], const float m[static 4],
+		float cx, float cy) {
+	affine[0] = m[0];
+	affine[1] = m[1];
+	affine[2] = cx - m[0] * cx - m[1] * cy;
+	affine[3] = m[2];
+	affine[4] = m[3];
+	affine[5] = cy - m[2] * cx - m[3] * cy;
+}
+
 void wlr_matrix_project_box(float (*mat)[16], struct wlr_box *box,
 		enum wl_output_transform transform, float rotation,
 		float (*projection)[16]) {
@@ -169,42 +174,42 @@ void wlr_matrix_project_box(float (*mat)[16], struct wlr_box *box,
 	int width = box->width;
 	int height = box->height;
 
-	wlr_matrix_translate(mat, x, y, 0);
+	// All the transformations below are 2D affine: compose them as such and
+	// only do a single 4x4 multiplication with the projection at the end
+	float affine[6] = {
+		1.0f, 0.0f, x,
+		0.0f, 1.0f, y,
+	};
 
 	if (rotation != 0) {
-		float translate_center[16];
-		wlr_matrix_translate(&translate_center, width/2, height/2, 0);
-
-		float rotate[16];
-		wlr_matrix_rotate(&rotate, rotation);
-
-		float translate_origin[16];
-		wlr_matrix_translate(&translate_origin, -width/2, -height/2, 0);
-
-		wlr_matrix_mul(mat, &translate_center, mat);
-		wlr_matrix_mul(mat, &rotate, mat);
-		wlr_matrix_mul(mat, &translate_origin, mat);
+		float c = cosf(rotation);
+		float s = sinf(rotation);
+		const float rotate[4] = {
+			c, s,
+			-s, c,
+		};
+		float rotate_center[6];
+		affine_around(rotate_center, rotate, width/2, height/2);
+		affine_mul(affine, rotate_center, affine);
 	}
 
-	float scale[16];
-	wlr_matrix_scale(&scale, width, height, 1);
-
-	wlr_matrix_mul(mat, &scale, mat);
+	// Scale to the box size
+	affine[0] *= width;
+	affine[3] *= width;
+	affine[1] *= height;
+	affine[4] *= height;
 
 	if (transform != WL_OUTPUT_TRANSFORM_NORMAL) {
-		float surface_translate_center[16];
-		wlr_matrix_translate(&surface_translate_center, 0.5, 0.5, 0);
-
-		float surface_transform[16];
-		wlr_matrix_transform(surface_transform, transform);
-
-		float surface_translate_origin[16];
-		wlr_matrix_translate(&surface_translate_origin, -0.5, -0.5, 0);
-
-		wlr_matrix_mul(mat, &surface_translate_center, mat);
-		wlr_matrix_mul(mat, &surface_transform, mat);
-		wlr_matrix_mul(mat, &surface_translate_origin, mat);
+		float surface_transform[6];
+		affine_around(surface_transform, transforms[transform], 0.5f, 0.5f);
+		affine_mul(affine, surface_transform, affine);
 	}
 
-	wlr_matrix_mul(projection, mat, mat);
+	float model[16] = {
+		affine[0], affine[1], 0.0f, affine[2],
+		affine[3], affine[4], 0.0f, affine[5],
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f,
+	};
+	wlr_matrix_mul(projection, &model, mat);
 }
@@ -16,6 +16,7 @@ void wlr_renderer_destroy(struct wlr_renderer *r) {
 }
 
 void wlr_renderer_begin(struct wlr_renderer *r, struct wlr_output *o) {
+	r->draw_calls = 0;
 	r->impl->begin(r, o);
 }
 
@@ -45,6 +46,18 @@ void wlr_render_colored_quad(struct wlr_renderer *r,
 	r->impl->render_quad(r, color, matrix);
 }
 
+bool wlr_render_with_matrix_clipped(struct wlr_renderer *r,
+		struct wlr_texture *texture, const float (*matrix)[16],
+		const struct wlr_box *clip) {
+	return r->impl->render_texture_clipped(r, texture, matrix, clip);
+}
+
+void wlr_render_colored_quad_clipped(struct wlr_renderer *r,
+		const float (*color)[4], const float (*matrix)[16],
+		const struct wlr_box *clip) {
+	r->impl->render_quad_clipped(r, color, matrix, clip);
+}
+
 void wlr_render_colored_ellipse(struct wlr_renderer *r,
 		const float (*color)[4], const float (*matrix)[16]) {
 	r->impl->render_ellipse(r, color, matrix);
@@ -68,7 +81,75 @@ bool wlr_renderer_read_pixels(struct wlr_renderer *r, enum wl_shm_format fmt,
 		dst_x, dst_y, data);
 }
 
+struct wlr_readback *wlr_renderer_read_pixels_async(struct wlr_renderer *r,
+		enum wl_shm_format fmt, uint32_t width, uint32_t height,
+		uint32_t src_x, uint32_t src_y) {
+	if (!r->impl->read_pixels_async) {
+		return NULL;
+	}
+	return r->impl->read_pixels_async(r, fmt, width, height, src_x, src_y);
+}
+
+uint32_t wlr_renderer_get_draw_calls(struct wlr_renderer *r) {
+	return r->draw_calls;
+}
+
+struct wlr_render_timer *wlr_render_timer_create(struct wlr_renderer *r) {
+	if (!r->impl->timer_create) {
+		return NULL;
+	}
+	return r->impl->timer_create(r);
+}
+
 bool wlr_renderer_format_supported(struct wlr_renderer *r,
 		enum wl_shm_format fmt) {
 	return r->impl->format_supported(r, fmt);
 }
+
+void wlr_readback_init(struct wlr_readback *readback,
+		struct wlr_readback_impl *impl) {
+	readback->impl = impl;
+}
+
+bool wlr_readback_ready(struct wlr_readback *readback) {
+	return readback->impl->ready(readback);
+}
+
+bool wlr_readback_finish(struct wlr_readback *readback, uint32_t stride,
+		uint32_t dst_x, uint32_t dst_y, void *data) {
+	return readback->impl->finish(readback, stride, dst_x, dst_y, data);
+}
+
+void wlr_readback_destroy(struct wlr_readback *readback) {
+	if (readback && readback->impl && readback->impl->destroy) {
+		readback->impl->destroy(readback);
+	} else {
+		free(readback);
+	}
+}
+
+void wlr_render_timer_init(struct wlr_render_timer *timer,
+		struct wlr_render_timer_impl *impl) {
+	timer->impl = impl;
+}
+
+void wlr_render_timer_begin(struct wlr_render_timer *timer) {
+	timer->impl->begin(timer);
+}
+
+void wlr_render_timer_end(struct wlr_render_timer *timer) {
+	timer->impl->end(timer);
+}
+
+bool wlr_render_timer_get_duration(struct wlr_render_timer *timer,
+		int64_t *duration) {
+	return timer->impl->get_duration(timer, duration);
+}
+
+void wlr_render_timer_destroy(struct wlr_render_timer *timer) {
+	if (timer && timer->impl && timer->impl->destroy) {
+		timer->impl->destroy(timer);
+	} else {
+		free(timer);
+	}
+}
@@ -43,6 +43,12 @@ bool wlr_texture_update_shm(struct wlr_texture *texture, uint32_t format,
 	return texture->impl->update_shm(texture, format, x, y, width, height, shm);
 }
 
+bool wlr_texture_update_shm_region(struct wlr_texture *texture,
+		uint32_t format, pixman_region32_t *region,
+		struct wl_shm_buffer *shm) {
+	return texture->impl->update_shm_region(texture, format, region, shm);
+}
+
 bool wlr_texture_upload_drm(struct wlr_texture *texture,
 		struct wl_resource *drm_buffer) {
 	return texture->impl->upload_drm(texture, drm_buffer);
@@ -114,7 +114,49 @@ static uint32_t parse_modifier(const char *symname) {
 	}
 }
 
-void add_binding_config(struct wl_list *bindings, const char* combination,
+static const char *exec_prefix = "exec ";
+
+static enum roots_binding_action parse_binding_action(const char *command) {
+	if (strcmp(command, "exit") == 0) {
+		return ROOTS_BINDING_EXIT;
+	} else if (strcmp(command, "close") == 0) {
+		return ROOTS_BINDING_CLOSE;
+	} else if (strcmp(command, "fullscreen") == 0) {
+		return ROOTS_BINDING_FULLSCREEN;
+	} else if (strcmp(command, "next_window") == 0) {
+		return ROOTS_BINDING_NEXT_WINDOW;
+	} else if (strncmp(exec_prefix, command, strlen(exec_prefix)) == 0) {
+		return ROOTS_BINDING_EXEC;
+	} else if (strcmp(command, "maximize") == 0) {
+		return ROOTS_BINDING_MAXIMIZE;
+	} else if (strcmp(command, "nop") == 0) {
+		return ROOTS_BINDING_NOP;
+	} else if (strcmp(command, "toggle_outputs") == 0) {
+		return ROOTS_BINDING_TOGGLE_OUTPUTS;
+	} else {
+		return ROOTS_BINDING_UNKNOWN;
+	}
+}
+
+static int keysym_cmp(const void *a, const void *b) {
+	xkb_keysym_t sa = *(const xkb_keysym_t *)a;
+	xkb_keysym_t sb = *(const xkb_keysym_t *)b;
+	return (sa > sb) - (sa < sb);
+}
+
+static uint32_t binding_hash(uint32_t modifiers, const xkb_keysym_t *keysyms,
+		size_t keysyms_len) {
+	// FNV-1a
+	uint32_t hash = 2166136261u ^ modifiers;
+	hash *= 16777619u;
+	for (size_t i = 0; i < keysyms_len; ++i) {
+		hash ^= keysyms[i];
+		hash *= 16777619u;
+	}
+	return hash & (ROOTS_CONFIG_BINDING_BUCKETS - 1);
+}
+
+void add_binding_config(struct roots_config *config, const char* combination,
 		const char* command) {
 	struct roots_binding_config *bc =
 		calloc(1, sizeof(struct roots_binding_config));
@@ -136,6 +178,13 @@ void add_binding_config(struct wl_list *bindings, const char* combination,
 				bc = NULL;
 				break;
 			}
+			if (bc->keysyms_len == ROOTS_KEYBOARD_PRESSED_KEYSYMS_CAP) {
+				wlr_log(L_ERROR, "too many keys in binding: %s",
+					combination);
+				free(bc);
+				bc = NULL;
+				break;
+			}
 			keysyms[bc->keysyms_len] = sym;
 			bc->keysyms_len++;
 		}
@@ -144,10 +193,23 @@ void add_binding_config(struct wl_list *bindings, const char* combination,
 	free(symnames);
 
 	if (bc) {
-		wl_list_insert(bindings, &bc->link);
+		wl_list_insert(&config->bindings, &bc->link);
 		bc->command = strdup(command);
 		bc->keysyms = malloc(bc->keysyms_len * sizeof(xkb_keysym_t));
 		memcpy(bc->keysyms, keysyms, bc->keysyms_len * sizeof(xkb_keysym_t));
+		qsort(bc->keysyms, bc->keysyms_len, sizeof(xkb_keysym_t), keysym_cmp);
+
+		bc->action = parse_binding_action(command);
+		if (bc->action == ROOTS_BINDING_EXEC) {
+			bc->exec_cmd = bc->command + strlen(exec_prefix);
+		} else if (bc->action == ROOTS_BINDING_UNKNOWN) {
+			wlr_log(L_ERROR, "unknown binding command: %s", command);
+		}
+
+		uint32_t hash =
+			binding_hash(bc->modifiers, bc->keysyms, bc->keysyms_len);
+		bc->next = config->binding_table[hash];
+		config->binding_table[hash] = bc;
 	}
 }
 
@@ -180,6 +242,14 @@ static void config_handle_cursor(struct roots_config *config,
 	} else if (strcmp(name, "default-image") == 0) {
 		free(cc->default_image);
 		cc->default_image = strdup(value);
+	} else if (strcmp(name, "coalesce-motion") == 0) {
+		if (strcasecmp(value, "true") == 0) {
+			cc->coalesce_motion = true;
+		} else if (strcasecmp(value, "false") == 0) {
+			cc->coalesce_motion = false;
+		} else {
+			wlr_log(L_ERROR, "got unknown coalesce-motion value: %s", value);
+		}
 	} else {
 		wlr_log(L_ERROR, "got unknown cursor config: %s", name);
 	}
@@ -238,6 +308,9 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 		if (strcmp(name, "xwayland") == 0) {
 			if (strcasecmp(value, "true") == 0) {
 				config->xwayland = true;
+			} else if (strcasecmp(value, "lazy") == 0) {
+				config->xwayland = true;
+				config->xwayland_lazy = true;
 			} else if (strcasecmp(value, "false") == 0) {
 				config->xwayland = false;
 			} else {
@@ -372,7 +445,7 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 		const char *device_name = section + strlen(keyboard_prefix);
 		config_handle_keyboard(config, device_name, name, value);
 	} else if (strcmp(section, "bindings") == 0) {
-		add_binding_config(&config->bindings, name, value);
+		add_binding_config(config, name, value);
 	} else {
 		wlr_log(L_ERROR, "got unknown config section: %s", section);
 	}
@@ -425,9 +498,9 @@ struct roots_config *roots_config_create_from_args(int argc, char *argv[]) {
 
 	if (result == -1) {
 		wlr_log(L_DEBUG, "No config file found. Using sensible defaults.");
-		add_binding_config(&config->bindings, "Logo+Shift+E", "exit");
-		add_binding_config(&config->bindings, "Ctrl+q", "close");
-		add_binding_config(&config->bindings, "Alt+Tab", "next_window");
+		add_binding_config(config, "Logo+Shift+E", "exit");
+		add_binding_config(config, "Ctrl+q", "close");
+		add_binding_config(config, "Alt+Tab", "next_window");
 		struct roots_keyboard_config *kc =
 			calloc(1, sizeof(struct roots_keyboard_config));
 		kc->meta_key = WLR_MODIFIER_LOGO;
@@ -492,6 +565,21 @@ void roots_config_destroy(struct roots_config *config) {
 	free(config);
 }
 
+struct roots_binding_config *roots_config_get_binding(
+		struct roots_config *config, uint32_t modifiers,
+		const xkb_keysym_t *keysyms, size_t keysyms_len) {
+	struct roots_binding_config *bc =
+		config->binding_table[binding_hash(modifiers, keysyms, keysyms_len)];
+	for (; bc != NULL; bc = bc->next) {
+		if (bc->modifiers == modifiers && bc->keysyms_len == keysyms_len &&
+				memcmp(bc->keysyms, keysyms,
+					keysyms_len * sizeof(xkb_keysym_t)) == 0) {
+			return bc;
+		}
+	}
+	return NULL;
+}
+
 struct roots_output_config *roots_config_get_output(struct roots_config *config,
 		struct wlr_output *output) {
 	char name[83];
@@ -11,6 +11,7 @@
 #include <wlr/types/wlr_idle.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_primary_selection.h>
+#include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_server_decoration.h>
 #include <wlr/types/wlr_wl_shell.h>
 #include <wlr/types/wlr_xcursor_manager.h>
@@ -312,6 +313,107 @@ bool view_center(struct roots_view *view) {
 	return true;
 }
 
+static int view_index_cell(int coord) {
+	// Round towards negative infinity
+	if (coord < 0) {
+		return -((-coord - 1) / ROOTS_VIEW_INDEX_CELL_SIZE) - 1;
+	}
+	return coord / ROOTS_VIEW_INDEX_CELL_SIZE;
+}
+
+static struct wl_list *view_index_bucket(struct roots_desktop *desktop,
+		int cell_x, int cell_y) {
+	uint32_t hash = (uint32_t)cell_x * 73856093 ^ (uint32_t)cell_y * 19349663;
+	return &desktop->view_index[hash % ROOTS_VIEW_INDEX_BUCKETS];
+}
+
+static void view_index_unlink(struct roots_view *view) {
+	for (size_t i = 0; i < view->index_entries_len; ++i) {
+		wl_list_remove(&view->index_entries[i].link);
+	}
+	view->index_entries_len = 0;
+	view->index_cells = (struct wlr_box){0};
+	view->index_large = false;
+}
+
+static void view_index_remove(struct roots_view *view) {
+	view_index_unlink(view);
+	free(view->index_entries);
+	view->index_entries = NULL;
+	view->index_entries_cap = 0;
+}
+
+/**
+ * Moves the view to the cells covered by its bounds, if they changed.
+ */
+static void view_update_index(struct roots_view *view) {
+	struct roots_desktop *desktop = view->desktop;
+	struct wlr_box box = {0};
+	if (view->scene_node->enabled) {
+		box = view->scene_node->layout.subtree_bounds;
+	}
+
+	struct wlr_box cells = {0};
+	if (!wlr_box_empty(&box)) {
+		cells.x = view_index_cell(box.x);
+		cells.y = view_index_cell(box.y);
+		cells.width = view_index_cell(box.x + box.width - 1) - cells.x + 1;
+		cells.height = view_index_cell(box.y + box.height - 1) - cells.y + 1;
+	}
+	if (cells.x == view->index_cells.x && cells.y == view->index_cells.y &&
+			cells.width == view->index_cells.width &&
+			cells.height == view->index_cells.height) {
+		return;
+	}
+
+	size_t ncells = (size_t)cells.width * cells.height;
+	bool large = ncells > ROOTS_VIEW_INDEX_MAX_CELLS;
+	if (large && view->index_large) {
+		// Large views aren't indexed by cell
+		view->index_cells = cells;
+		return;
+	}
+
+	view_index_unlink(view);
+	if (wlr_box_empty(&cells)) {
+		return;
+	}
+
+	// Entries are only reallocated when the view covers more cells than ever
+	size_t len = large ? 1 : ncells;
+	if (len > view->index_entries_cap) {
+		struct roots_view_index_entry *entries = realloc(view->index_entries,
+			len * sizeof(struct roots_view_index_entry));
+		if (entries == NULL) {
+			wlr_log(L_ERROR, "Allocation failed");
+			return;
+		}
+		view->index_entries = entries;
+		view->index_entries_cap = len;
+	}
+	view->index_cells = cells;
+
+	if (large) {
+		view->index_entries[0].view = view;
+		wl_list_insert(&desktop->view_index_large,
+			&view->index_entries[0].link);
+		view->index_entries_len = 1;
+		view->index_large = true;
+		return;
+	}
+
+	for (int y = cells.y; y < cells.y + cells.height; ++y) {
+		for (int x = cells.x; x < cells.x + cells.width; ++x) {
+			struct roots_view_index_entry *entry =
+				&view->index_entries[view->index_entries_len++];
+			entry->view = view;
+			entry->cell_x = x;
+			entry->cell_y = y;
+			wl_list_insert(view_index_bucket(desktop, x, y), &entry->link);
+		}
+	}
+}
+
 void view_child_finish(struct roots_view_child *child) {
 	if (child == NULL) {
 		return;
@@ -320,6 +422,10 @@ void view_child_finish(struct roots_view_child *child) {
 	wl_list_remove(&child->link);
 	wl_list_remove(&child->commit.link);
 	wl_list_remove(&child->new_subsurface.link);
+	if (child->scene_node != NULL) {
+		wl_list_remove(&child->scene_node_destroy.link);
+		wlr_scene_node_destroy(child->scene_node);
+	}
 }
 
 static void view_child_handle_commit(struct wl_listener *listener,
@@ -348,6 +454,29 @@ void view_child_init(struct roots_view_child *child, struct roots_view *view,
 	wl_list_insert(&view->children, &child->link);
 }
 
+static void view_child_handle_scene_node_destroy(struct wl_listener *listener,
+		void *data) {
+	// The parent node has been destroyed
+	struct roots_view_child *child =
+		wl_container_of(listener, child, scene_node_destroy);
+	wl_list_remove(&child->scene_node_destroy.link);
+	child->scene_node = NULL;
+}
+
+void view_child_create_scene_node(struct roots_view_child *child,
+		struct wlr_scene_node *parent) {
+	if (parent == NULL) {
+		return;
+	}
+	child->scene_node = wlr_scene_surface_create(parent, child->wlr_surface);
+	if (child->scene_node == NULL) {
+		return;
+	}
+	child->scene_node_destroy.notify = view_child_handle_scene_node_destroy;
+	wl_signal_add(&child->scene_node->events.destroy,
+		&child->scene_node_destroy);
+}
+
 static void subsurface_destroy(struct roots_view_child *child) {
 	assert(child->destroy == subsurface_destroy);
 	struct roots_subsurface *subsurface = (struct roots_subsurface *)child;
@@ -392,6 +521,9 @@ void view_finish(struct roots_view *view) {
 		child->destroy(child);
 	}
 
+	view_index_remove(view);
+	wlr_scene_node_destroy(view->scene_node);
+
 	if (view->fullscreen_output) {
 		view->fullscreen_output->fullscreen_view = NULL;
 	}
@@ -421,9 +553,55 @@ void view_init(struct roots_view *view, struct roots_desktop *desktop) {
 	wl_signal_add(&view->wlr_surface->events.new_subsurface,
 		&view->new_subsurface);
 
+	// Decorations are below the surface
+	view->scene_node = wlr_scene_node_create(NULL);
+	assert(view->scene_node);
+	view->deco_node = wlr_scene_node_create(view->scene_node);
+	assert(view->deco_node);
+	view->surface_node =
+		wlr_scene_surface_create(view->scene_node, view->wlr_surface);
+
 	view_damage_whole(view);
 }
 
+void view_update_scene(struct roots_view *view) {
+	struct wlr_scene_node *node = view->scene_node;
+
+	// Children rotate around the view surface center
+	int width = 0, height = 0;
+	if (view->wlr_surface != NULL) {
+		width = view->wlr_surface->current->width;
+		height = view->wlr_surface->current->height;
+	}
+	wlr_scene_node_set_position(node, view->x, view->y);
+	wlr_scene_node_set_size(node, width, height);
+	wlr_scene_node_set_rotation(node, view->rotation);
+
+	if (view->type == ROOTS_WL_SHELL_VIEW) {
+		// Popups are displayed with their parent
+		wlr_scene_node_set_enabled(node,
+			view->wl_shell_surface->state != WLR_WL_SHELL_SURFACE_STATE_POPUP);
+	}
+
+	struct wlr_box deco_box;
+	view_get_deco_box(view, &deco_box);
+	wlr_scene_node_set_position(view->deco_node, deco_box.x - view->x,
+		deco_box.y - view->y);
+	wlr_scene_node_set_size(view->deco_node, deco_box.width, deco_box.height);
+	wlr_scene_node_set_enabled(view->deco_node,
+		view->decorated && view->wlr_surface != NULL);
+
+	struct roots_view_child *child;
+	wl_list_for_each(child, &view->children, link) {
+		if (child->scene_node != NULL && child->update_scene != NULL) {
+			child->update_scene(child);
+		}
+	}
+
+	wlr_scene_node_update(node);
+	view_update_index(view);
+}
+
 void view_setup(struct roots_view *view) {
 	struct roots_input *input = view->desktop->server->input;
 	// TODO what seat gets focus? the one with the last input event?
@@ -437,6 +615,9 @@ void view_setup(struct roots_view *view) {
 }
 
 void view_apply_damage(struct roots_view *view) {
+	// Also keeps the view index up-to-date, even without any output
+	view_update_scene(view);
+
 	struct roots_output *output;
 	wl_list_for_each(output, &view->desktop->outputs, link) {
 		output_damage_from_view(output, view);
@@ -444,6 +625,8 @@ void view_apply_damage(struct roots_view *view) {
 }
 
 void view_damage_whole(struct roots_view *view) {
+	view_update_scene(view);
+
 	struct roots_output *output;
 	wl_list_for_each(output, &view->desktop->outputs, link) {
 		output_damage_whole_view(output, view);
@@ -572,13 +755,45 @@ struct roots_view *desktop_view_at(struct roots_desktop *desktop, double lx,
 		}
 	}
 
-	struct roots_view *view;
-	wl_list_for_each(view, &desktop->views, link) {
-		if (view_at(view, lx, ly, surface, sx, sy)) {
-			return view;
+	// Only test the views whose bounds cover the cell under the point, and
+	// keep the topmost one
+	struct roots_view *found = NULL;
+	int cell_x = view_index_cell(floor(lx));
+	int cell_y = view_index_cell(floor(ly));
+	struct wl_list *lists[] = {
+		view_index_bucket(desktop, cell_x, cell_y),
+		&desktop->view_index_large,
+	};
+	for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i) {
+		struct roots_view_index_entry *entry;
+		wl_list_for_each(entry, lists[i], link) {
+			struct roots_view *view = entry->view;
+			if (lists[i] != &desktop->view_index_large &&
+					(entry->cell_x != cell_x || entry->cell_y != cell_y)) {
+				continue;
+			}
+			if (view->wlr_surface == NULL || (found != NULL &&
+					found->stack_serial > view->stack_serial)) {
+				continue;
+			}
+
+			struct wlr_surface *_surface;
+			double _sx, _sy;
+			if (view_at(view, lx, ly, &_surface, &_sx, &_sy)) {
+				found = view;
+				*surface = _surface;
+				*sx = _sx;
+				*sy = _sy;
+			}
 		}
 	}
-	return NULL;
+	return found;
+}
+
+void desktop_insert_view(struct roots_desktop *desktop,
+		struct roots_view *view) {
+	wl_list_insert(&desktop->views, &view->link);
+	view->stack_serial = ++desktop->view_stack_serial;
 }
 
 static void handle_layout_change(struct wl_listener *listener, void *data) {
@@ -620,6 +835,10 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 
 	wl_list_init(&desktop->views);
 	wl_list_init(&desktop->outputs);
+	for (size_t i = 0; i < ROOTS_VIEW_INDEX_BUCKETS; ++i) {
+		wl_list_init(&desktop->view_index[i]);
+	}
+	wl_list_init(&desktop->view_index_large);
 
 	desktop->new_output.notify = handle_new_output;
 	wl_signal_add(&server->backend->events.new_output, &desktop->new_output);
@@ -667,7 +886,7 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 
 	if (config->xwayland) {
 		desktop->xwayland = wlr_xwayland_create(server->wl_display,
-			desktop->compositor);
+			desktop->compositor, config->xwayland_lazy);
 		wl_signal_add(&desktop->xwayland->events.new_surface,
 			&desktop->xwayland_surface);
 		desktop->xwayland_surface.notify = handle_xwayland_surface;
@@ -689,6 +908,8 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 	desktop->gamma_control_manager = wlr_gamma_control_manager_create(
 		server->wl_display);
 	desktop->screenshooter = wlr_screenshooter_create(server->wl_display);
+	desktop->screencast_manager =
+		wlr_screencast_manager_create(server->wl_display);
 	desktop->server_decoration_manager =
 		wlr_server_decoration_manager_create(server->wl_display);
 	wlr_server_decoration_manager_set_default_mode(
@@ -24,12 +24,23 @@ static ssize_t pressed_keysyms_index(xkb_keysym_t *pressed_keysyms,
 	return -1;
 }
 
-static size_t pressed_keysyms_length(xkb_keysym_t *pressed_keysyms) {
+/**
+ * Copies the pressed keysyms into `sorted`, in ascending order. Returns the
+ * number of pressed keysyms.
+ */
+static size_t pressed_keysyms_sorted(xkb_keysym_t *pressed_keysyms,
+		xkb_keysym_t *sorted) {
 	size_t n = 0;
 	for (size_t i = 0; i < ROOTS_KEYBOARD_PRESSED_KEYSYMS_CAP; ++i) {
-		if (pressed_keysyms[i] != XKB_KEY_NoSymbol) {
-			++n;
+		xkb_keysym_t keysym = pressed_keysyms[i];
+		if (keysym == XKB_KEY_NoSymbol) {
+			continue;
 		}
+		size_t j = n++;
+		for (; j > 0 && sorted[j - 1] > keysym; --j) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = keysym;
 	}
 	return n;
 }
@@ -84,52 +95,62 @@ static void pressed_keysyms_update(xkb_keysym_t *pressed_keysyms,
 	}
 }
 
-static const char *exec_prefix = "exec ";
-
 static bool outputs_enabled = true;
 
 static void keyboard_binding_execute(struct roots_keyboard *keyboard,
-		const char *command) {
+		struct roots_binding_config *bc) {
 	struct roots_seat *seat = keyboard->seat;
-	if (strcmp(command, "exit") == 0) {
+	struct roots_view *focus;
+	switch (bc->action) {
+	case ROOTS_BINDING_EXIT:
 		wl_display_terminate(keyboard->input->server->wl_display);
-	} else if (strcmp(command, "close") == 0) {
-		struct roots_view *focus = roots_seat_get_focus(seat);
+		break;
+	case ROOTS_BINDING_CLOSE:
+		focus = roots_seat_get_focus(seat);
 		if (focus != NULL) {
 			view_close(focus);
 		}
-	} else if (strcmp(command, "fullscreen") == 0) {
-		struct roots_view *focus = roots_seat_get_focus(seat);
+		break;
+	case ROOTS_BINDING_FULLSCREEN:
+		focus = roots_seat_get_focus(seat);
 		if (focus != NULL) {
 			bool is_fullscreen = focus->fullscreen_output != NULL;
 			view_set_fullscreen(focus, !is_fullscreen, NULL);
 		}
-	} else if (strcmp(command, "next_window") == 0) {
+		break;
+	case ROOTS_BINDING_NEXT_WINDOW:
 		roots_seat_cycle_focus(seat);
-	} else if (strncmp(exec_prefix, command, strlen(exec_prefix)) == 0) {
-		const char *shell_cmd = command + strlen(exec_prefix);
+		break;
+	case ROOTS_BINDING_EXEC: {
 		pid_t pid = fork();
 		if (pid < 0) {
 			wlr_log(L_ERROR, "cannot execute binding command: fork() failed");
 			return;
 		} else if (pid == 0) {
-			execl("/bin/sh", "/bin/sh", "-c", shell_cmd, (void *)NULL);
+			execl("/bin/sh", "/bin/sh", "-c", bc->exec_cmd, (void *)NULL);
 		}
-	} else if (strcmp(command, "maximize") == 0) {
-		struct roots_view *focus = roots_seat_get_focus(seat);
+		break;
+	}
+	case ROOTS_BINDING_MAXIMIZE:
+		focus = roots_seat_get_focus(seat);
 		if (focus != NULL) {
 			view_maximize(focus, !focus->maximized);
 		}
-	} else if (strcmp(command, "nop") == 0) {
+		break;
+	case ROOTS_BINDING_NOP:
 		wlr_log(L_DEBUG, "nop command");
-	} else if (strcmp(command, "toggle_outputs") == 0) {
+		break;
+	case ROOTS_BINDING_TOGGLE_OUTPUTS: {
 		outputs_enabled = !outputs_enabled;
 		struct roots_output *output;
 		wl_list_for_each(output, &keyboard->input->server->desktop->outputs, link) {
 			wlr_output_enable(output->wlr_output, outputs_enabled);
 		}
-	} else {
-		wlr_log(L_ERROR, "unknown binding command: %s", command);
+		break;
+	}
+	case ROOTS_BINDING_UNKNOWN:
+		wlr_log(L_ERROR, "unknown binding command: %s", bc->command);
+		break;
 	}
 }
 
@@ -182,30 +203,16 @@ static bool keyboard_execute_binding(struct roots_keyboard *keyboard,
 	}
 
 	// User-defined bindings
-	size_t n = pressed_keysyms_length(pressed_keysyms);
-	struct wl_list *bindings = &keyboard->input->server->config->bindings;
-	struct roots_binding_config *bc;
-	wl_list_for_each(bc, bindings, link) {
-		if (modifiers ^ bc->modifiers || n != bc->keysyms_len) {
-			continue;
-		}
-
-		bool ok = true;
-		for (size_t i = 0; i < bc->keysyms_len; i++) {
-			ssize_t j = pressed_keysyms_index(pressed_keysyms, bc->keysyms[i]);
-			if (j < 0) {
-				ok = false;
-				break;
-			}
-		}
-
-		if (ok) {
-			keyboard_binding_execute(keyboard, bc->command);
-			return true;
-		}
+	xkb_keysym_t sorted[ROOTS_KEYBOARD_PRESSED_KEYSYMS_CAP];
+	size_t n = pressed_keysyms_sorted(pressed_keysyms, sorted);
+	struct roots_binding_config *bc = roots_config_get_binding(
+		keyboard->input->server->config, modifiers, sorted, n);
+	if (bc == NULL) {
+		return false;
 	}
 
-	return false;
+	keyboard_binding_execute(keyboard, bc);
+	return true;
 }
 
 /*
@@ -70,10 +70,14 @@ int main(int argc, char **argv) {
 		struct roots_seat *xwayland_seat =
 			input_get_seat(server.input, ROOTS_CONFIG_DEFAULT_SEAT_NAME);
 		wlr_xwayland_set_seat(server.desktop->xwayland, xwayland_seat->seat);
+	}
+
+	if (server.desktop->xwayland != NULL && !server.config->xwayland_lazy) {
 		wl_signal_add(&server.desktop->xwayland->events.ready,
 			&server.desktop->xwayland_ready);
 		server.desktop->xwayland_ready.notify = ready;
 	} else {
+		// In lazy mode, $DISPLAY is already usable
 		ready(NULL, NULL);
 	}
 #endif
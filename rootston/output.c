@@ -1,11 +1,13 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <time.h>
 #include <wlr/render/matrix.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_wl_shell.h>
 #include <wlr/types/wlr_xdg_shell_v6.h>
 #include <wlr/util/log.h>
@@ -14,139 +16,61 @@
 #include "rootston/output.h"
 #include "rootston/server.h"
 
-typedef void (*surface_iterator_func_t)(struct wlr_surface *surface,
-	double lx, double ly, float rotation, void *data);
-
 /**
- * Rotate a child's position relative to a parent. The parent size is (pw, ph),
- * the child position is (*sx, *sy) and its size is (sw, sh).
+ * Gets the box of a scene node in output-local coordinates, before rotation.
+ * `output_box` is the output box in layout coordinates.
  */
-static void rotate_child_position(double *sx, double *sy, double sw, double sh,
-		double pw, double ph, float rotation) {
-	if (rotation != 0.0) {
-		// Coordinates relative to the center of the subsurface
-		double ox = *sx - pw/2 + sw/2,
-			oy = *sy - ph/2 + sh/2;
-		// Rotated coordinates
-		double rx = cos(-rotation)*ox - sin(-rotation)*oy,
-			ry = cos(-rotation)*oy + sin(-rotation)*ox;
-		*sx = rx + pw/2 - sw/2;
-		*sy = ry + ph/2 - sh/2;
-	}
-}
-
-static void surface_for_each_surface(struct wlr_surface *surface, double lx,
-		double ly, float rotation, surface_iterator_func_t iterator,
-		void *user_data) {
-	iterator(surface, lx, ly, rotation, user_data);
-
-	struct wlr_subsurface *subsurface;
-	wl_list_for_each(subsurface, &surface->subsurface_list, parent_link) {
-		struct wlr_surface_state *state = subsurface->surface->current;
-		double sx = state->subsurface_position.x;
-		double sy = state->subsurface_position.y;
-		rotate_child_position(&sx, &sy, state->width, state->height,
-			surface->current->width, surface->current->height, rotation);
-
-		surface_for_each_surface(subsurface->surface, lx + sx, ly + sy,
-			rotation, iterator, user_data);
-	}
+static void scene_node_output_box(struct wlr_scene_node *node,
+		struct roots_output *output, const struct wlr_box *output_box,
+		struct wlr_box *box) {
+	float scale = output->wlr_output->scale;
+	box->x = (node->layout.x - output_box->x) * scale;
+	box->y = (node->layout.y - output_box->y) * scale;
+	box->width = node->width * scale;
+	box->height = node->height * scale;
 }
 
-static void xdg_surface_v6_for_each_surface(struct wlr_xdg_surface_v6 *surface,
-		double base_x, double base_y, float rotation,
-		surface_iterator_func_t iterator, void *user_data) {
-	double width = surface->surface->current->width;
-	double height = surface->surface->current->height;
-
-	struct wlr_xdg_popup_v6 *popup_state;
-	wl_list_for_each(popup_state, &surface->popups, link) {
-		struct wlr_xdg_surface_v6 *popup = popup_state->base;
-		if (!popup->configured) {
-			continue;
-		}
-
-		double popup_width = popup->surface->current->width;
-		double popup_height = popup->surface->current->height;
-
-		double popup_sx, popup_sy;
-		wlr_xdg_surface_v6_popup_get_position(popup, &popup_sx, &popup_sy);
-		rotate_child_position(&popup_sx, &popup_sy, popup_width, popup_height,
-			width, height, rotation);
-
-		surface_for_each_surface(popup->surface, base_x + popup_sx,
-			base_y + popup_sy, rotation, iterator, user_data);
-		xdg_surface_v6_for_each_surface(popup, base_x + popup_sx,
-			base_y + popup_sy, rotation, iterator, user_data);
-	}
-}
-
-static void wl_shell_surface_for_each_surface(
-		struct wlr_wl_shell_surface *surface, double lx, double ly,
-		float rotation, bool is_child, surface_iterator_func_t iterator,
-		void *user_data) {
-	if (is_child || surface->state != WLR_WL_SHELL_SURFACE_STATE_POPUP) {
-		surface_for_each_surface(surface->surface, lx, ly, rotation, iterator,
-			user_data);
-
-		double width = surface->surface->current->width;
-		double height = surface->surface->current->height;
-
-		struct wlr_wl_shell_surface *popup;
-		wl_list_for_each(popup, &surface->popups, popup_link) {
-			double popup_width = popup->surface->current->width;
-			double popup_height = popup->surface->current->height;
-
-			double popup_x = popup->transient_state->x;
-			double popup_y = popup->transient_state->y;
-			rotate_child_position(&popup_x, &popup_y, popup_width, popup_height,
-				width, height, rotation);
-
-			wl_shell_surface_for_each_surface(popup, lx + popup_x, ly + popup_y,
-				rotation, true, iterator, user_data);
-		}
-	}
-}
-
-static void view_for_each_surface(struct roots_view *view,
-		surface_iterator_func_t iterator, void *user_data) {
-	switch (view->type) {
-	case ROOTS_XDG_SHELL_V6_VIEW:
-		surface_for_each_surface(view->wlr_surface, view->x, view->y,
-			view->rotation, iterator, user_data);
-		xdg_surface_v6_for_each_surface(view->xdg_surface_v6, view->x, view->y,
-			view->rotation, iterator, user_data);
-		break;
-	case ROOTS_WL_SHELL_VIEW:
-		wl_shell_surface_for_each_surface(view->wl_shell_surface, view->x,
-			view->y, view->rotation, false, iterator, user_data);
-		break;
-#ifdef WLR_HAS_XWAYLAND
-	case ROOTS_XWAYLAND_VIEW:
-		if (view->wlr_surface != NULL) {
-			surface_for_each_surface(view->wlr_surface, view->x, view->y,
-				view->rotation, iterator, user_data);
-		}
-		break;
-#endif
+/**
+ * Gets the smallest box containing a rotated scene node, in output-local
+ * coordinates. `box` is the node box returned by scene_node_output_box.
+ */
+static void scene_node_output_bounds(struct wlr_scene_node *node,
+		struct roots_output *output, const struct wlr_box *output_box,
+		const struct wlr_box *box, struct wlr_box *bounds) {
+	if (node->layout.rotation == 0) {
+		*bounds = *box;
+		return;
 	}
-}
 
-#ifdef WLR_HAS_XWAYLAND
-static void xwayland_children_for_each_surface(
-		struct wlr_xwayland_surface *surface,
-		surface_iterator_func_t iterator, void *user_data) {
-	struct wlr_xwayland_surface *child;
-	wl_list_for_each(child, &surface->children, parent_link) {
-		if (child->surface != NULL && child->added) {
-			surface_for_each_surface(child->surface, child->x, child->y, 0,
-				iterator, user_data);
-		}
-		xwayland_children_for_each_surface(child, iterator, user_data);
-	}
+	// Scale the cached layout bounds instead of rotating the box again
+	float scale = output->wlr_output->scale;
+	const struct wlr_box *layout_bounds = &node->layout.bounds;
+	int x1 = floor((layout_bounds->x - output_box->x) * scale);
+	int y1 = floor((layout_bounds->y - output_box->y) * scale);
+	int x2 = ceil((layout_bounds->x + layout_bounds->width - output_box->x) *
+		scale);
+	int y2 = ceil((layout_bounds->y + layout_bounds->height - output_box->y) *
+		scale);
+	bounds->x = x1;
+	bounds->y = y1;
+	bounds->width = x2 - x1;
+	bounds->height = y2 - y1;
 }
-#endif
 
+/**
+ * Something to paint on the output: either a surface or a view decoration.
+ */
+struct render_item {
+	struct roots_view *view; // only for decorations
+	struct wlr_surface *surface; // only for surfaces
+	struct wlr_box box; // output-local coordinates, before rotation
+	struct wlr_box bounds; // output-local coordinates, after rotation
+	float rotation;
+	bool overlay; // displayed on a hardware overlay plane
+
+	// visible damaged region, in output-local coordinates
+	pixman_region32_t damage;
+};
 
 struct render_data {
 	struct roots_output *output;
@@ -155,38 +79,17 @@ struct render_data {
 };
 
 /**
- * Checks whether a surface at (lx, ly) intersects an output. Sets `box` to the
- * surface box in the output, in output-local coordinates.
+ * Converts a damage rectangle in output-local coordinates to a box in renderer
+ * coordinates, suitable for scissoring and clipping.
  */
-static bool surface_intersect_output(struct wlr_surface *surface,
-		struct wlr_output_layout *output_layout, struct wlr_output *wlr_output,
-		double lx, double ly, float rotation, struct wlr_box *box) {
-	double ox = lx, oy = ly;
-	wlr_output_layout_output_coords(output_layout, wlr_output, &ox, &oy);
-	box->x = ox * wlr_output->scale;
-	box->y = oy * wlr_output->scale;
-	box->width = surface->current->width * wlr_output->scale;
-	box->height = surface->current->height * wlr_output->scale;
-
-	struct wlr_box layout_box = {
-		.x = lx, .y = ly,
-		.width = surface->current->width, .height = surface->current->height,
-	};
-	wlr_box_rotated_bounds(&layout_box, -rotation, &layout_box);
-	return wlr_output_layout_intersects(output_layout, wlr_output, &layout_box);
-}
-
-static void scissor_output(struct roots_output *output, pixman_box32_t *rect) {
+static void get_scissor_box(struct roots_output *output, pixman_box32_t *rect,
+		struct wlr_box *box) {
 	struct wlr_output *wlr_output = output->wlr_output;
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(wlr_output->backend);
-	assert(renderer);
 
-	struct wlr_box box = {
-		.x = rect->x1,
-		.y = rect->y1,
-		.width = rect->x2 - rect->x1,
-		.height = rect->y2 - rect->y1,
-	};
+	box->x = rect->x1;
+	box->y = rect->y1;
+	box->width = rect->x2 - rect->x1;
+	box->height = rect->y2 - rect->y1;
 
 	int ow, oh;
 	wlr_output_transformed_resolution(output->wlr_output, &ow, &oh);
@@ -195,140 +98,320 @@ static void scissor_output(struct roots_output *output, pixman_box32_t *rect) {
 	enum wl_output_transform transform = wlr_output_transform_compose(
 		wlr_output_transform_invert(wlr_output->transform),
 		WL_OUTPUT_TRANSFORM_FLIPPED_180);
-	wlr_box_transform(&box, transform, ow, oh, &box);
-
-	wlr_renderer_scissor(renderer, &box);
+	wlr_box_transform(box, transform, ow, oh, box);
 }
 
-static void render_surface(struct wlr_surface *surface, double lx, double ly,
-		float rotation, void *_data) {
-	struct render_data *data = _data;
-	struct roots_output *output = data->output;
-	struct timespec *when = data->when;
+static void scissor_output(struct roots_output *output, pixman_box32_t *rect) {
 	struct wlr_renderer *renderer =
 		wlr_backend_get_renderer(output->wlr_output->backend);
 	assert(renderer);
 
-	if (!wlr_surface_has_buffer(surface)) {
-		return;
-	}
-
 	struct wlr_box box;
-	bool intersects = surface_intersect_output(surface, output->desktop->layout,
-		output->wlr_output, lx, ly, rotation, &box);
-	if (!intersects) {
-		return;
-	}
-
-	struct wlr_box rotated;
-	wlr_box_rotated_bounds(&box, -rotation, &rotated);
+	get_scissor_box(output, rect, &box);
+	wlr_renderer_scissor(renderer, &box);
+}
 
-	pixman_region32_t damage;
-	pixman_region32_init(&damage);
-	pixman_region32_union_rect(&damage, &damage, rotated.x, rotated.y,
-		rotated.width, rotated.height);
-	pixman_region32_intersect(&damage, &damage, data->damage);
-	bool damaged = pixman_region32_not_empty(&damage);
-	if (!damaged) {
-		goto damage_finish;
-	}
+static void render_surface(struct render_item *item, struct render_data *data) {
+	struct wlr_surface *surface = item->surface;
+	struct roots_output *output = data->output;
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(output->wlr_output->backend);
+	assert(renderer);
 
 	float matrix[16];
 	enum wl_output_transform transform =
 		wlr_output_transform_invert(surface->current->transform);
-	wlr_matrix_project_box(&matrix, &box, transform, rotation,
+	wlr_matrix_project_box(&matrix, &item->box, transform, item->rotation,
 		&output->wlr_output->transform_matrix);
 
+	// Quads are batched by the renderer, so that all damaged rectangles of the
+	// surface are drawn at once
 	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	pixman_box32_t *rects = pixman_region32_rectangles(data->damage, &nrects);
 	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_with_matrix(renderer, surface->texture, &matrix);
+		struct wlr_box clip;
+		get_scissor_box(output, &rects[i], &clip);
+		wlr_render_with_matrix_clipped(renderer, surface->texture, &matrix,
+			&clip);
 	}
 
-	wlr_surface_send_frame_done(surface, when);
-
-damage_finish:
-	pixman_region32_fini(&damage);
+	wlr_surface_send_frame_done(surface, data->when);
 }
 
-static void get_decoration_box(struct roots_view *view,
-		struct roots_output *output, struct wlr_box *box) {
-	struct wlr_output *wlr_output = output->wlr_output;
-
-	struct wlr_box deco_box;
-	view_get_deco_box(view, &deco_box);
-	double sx = deco_box.x - view->x;
-	double sy = deco_box.y - view->y;
-	rotate_child_position(&sx, &sy, deco_box.width, deco_box.height,
-		view->wlr_surface->current->width,
-		view->wlr_surface->current->height, view->rotation);
-	double x = sx + view->x;
-	double y = sy + view->y;
-
-	wlr_output_layout_output_coords(output->desktop->layout, wlr_output, &x, &y);
-
-	box->x = x * wlr_output->scale;
-	box->y = y * wlr_output->scale;
-	box->width = deco_box.width * wlr_output->scale;
-	box->height = deco_box.height * wlr_output->scale;
-}
-
-static void render_decorations(struct roots_view *view,
+static void render_decorations(struct render_item *item,
 		struct render_data *data) {
-	if (!view->decorated || view->wlr_surface == NULL) {
-		return;
-	}
-
 	struct roots_output *output = data->output;
 	struct wlr_renderer *renderer =
 		wlr_backend_get_renderer(output->wlr_output->backend);
 	assert(renderer);
 
-	struct wlr_box box;
-	get_decoration_box(view, output, &box);
-
-	struct wlr_box rotated;
-	wlr_box_rotated_bounds(&box, -view->rotation, &rotated);
-
-	pixman_region32_t damage;
-	pixman_region32_init(&damage);
-	pixman_region32_union_rect(&damage, &damage, rotated.x, rotated.y,
-		rotated.width, rotated.height);
-	pixman_region32_intersect(&damage, &damage, data->damage);
-	bool damaged = pixman_region32_not_empty(&damage);
-	if (!damaged) {
-		goto damage_finish;
-	}
-
 	float matrix[16];
-	wlr_matrix_project_box(&matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL,
-		view->rotation, &output->wlr_output->transform_matrix);
+	wlr_matrix_project_box(&matrix, &item->box, WL_OUTPUT_TRANSFORM_NORMAL,
+		item->rotation, &output->wlr_output->transform_matrix);
 	float color[] = { 0.2, 0.2, 0.2, 1 };
 
 	int nrects;
-	pixman_box32_t *rects =
-		pixman_region32_rectangles(&damage, &nrects);
+	pixman_box32_t *rects = pixman_region32_rectangles(data->damage, &nrects);
 	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_colored_quad(renderer, &color, &matrix);
+		struct wlr_box clip;
+		get_scissor_box(output, &rects[i], &clip);
+		wlr_render_colored_quad_clipped(renderer, &color, &matrix, &clip);
 	}
+}
 
-damage_finish:
-	pixman_region32_fini(&damage);
+struct collect_data {
+	struct roots_output *output;
+	const struct wlr_box *output_box; // layout coordinates
+	struct roots_view *view; // NULL if decorations aren't rendered
+	struct wl_array *items;
+};
+
+static void collect_node(struct wlr_scene_node *node, void *_data) {
+	struct collect_data *data = _data;
+	struct roots_view *view = NULL;
+	if (node->surface != NULL) {
+		if (!wlr_surface_has_buffer(node->surface)) {
+			return;
+		}
+	} else if (data->view != NULL && node == data->view->deco_node) {
+		view = data->view;
+	} else {
+		return;
+	}
+
+	struct render_item *item =
+		wl_array_add(data->items, sizeof(struct render_item));
+	if (item == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return;
+	}
+	item->view = view;
+	item->surface = node->surface;
+	item->rotation = node->layout.rotation;
+	item->overlay = false;
+	scene_node_output_box(node, data->output, data->output_box, &item->box);
+	scene_node_output_bounds(node, data->output, data->output_box, &item->box,
+		&item->bounds);
 }
 
-static void render_view(struct roots_view *view, struct render_data *data) {
+static void collect_view(struct roots_view *view, struct collect_data *data) {
 	// Do not render views fullscreened on other outputs
 	if (view->fullscreen_output != NULL &&
 			view->fullscreen_output != data->output) {
 		return;
 	}
 
-	render_decorations(view, data);
-	view_for_each_surface(view, render_surface, data);
+	view_update_scene(view);
+	data->view = view;
+	wlr_scene_node_for_each_in_box(view->scene_node, data->output_box,
+		collect_node, data);
+	data->view = NULL;
+}
+
+/**
+ * Subtracts the opaque part of a surface, in output-local coordinates, from
+ * `region`. `box` is the surface box on the output.
+ */
+static void subtract_surface_opaque(struct roots_output *output,
+		struct wlr_surface *surface, struct wlr_box *box,
+		pixman_region32_t *region) {
+	float scale = output->wlr_output->scale;
+	if (scale != floor(scale)) {
+		// Scaling would grow the opaque region to the pixel grid
+		return;
+	}
+
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	pixman_region32_intersect_rect(&opaque, &surface->current->opaque, 0, 0,
+		surface->current->width, surface->current->height);
+	wlr_region_scale(&opaque, &opaque, scale);
+	pixman_region32_translate(&opaque, box->x, box->y);
+	pixman_region32_subtract(region, region, &opaque);
+	pixman_region32_fini(&opaque);
 }
 
+/**
+ * Walks render items front to back and computes the damage of each of them
+ * that isn't hidden behind an opaque item above it. On return, `remaining`
+ * contains the damage not covered by any opaque item.
+ */
+static void compute_visible_damage(struct roots_output *output,
+		struct wl_array *items, pixman_region32_t *remaining) {
+	struct render_item *list = items->data;
+	int nitems = items->size / sizeof(struct render_item);
+	for (int i = nitems - 1; i >= 0; --i) {
+		struct render_item *item = &list[i];
+		pixman_region32_init(&item->damage);
+		if (!pixman_region32_not_empty(remaining)) {
+			// Everything below is hidden
+			continue;
+		}
+
+		struct wlr_box *box = &item->box;
+		if (item->overlay) {
+			// Nothing to render, and nothing below is visible
+			pixman_region32_t overlay;
+			pixman_region32_init_rect(&overlay, box->x, box->y, box->width,
+				box->height);
+			pixman_region32_subtract(remaining, remaining, &overlay);
+			pixman_region32_fini(&overlay);
+			continue;
+		}
+
+		pixman_region32_union_rect(&item->damage, &item->damage,
+			item->bounds.x, item->bounds.y,
+			item->bounds.width, item->bounds.height);
+		pixman_region32_intersect(&item->damage, &item->damage, remaining);
+
+		if (item->rotation != 0 || !pixman_region32_not_empty(&item->damage)) {
+			continue;
+		}
+		if (item->surface != NULL) {
+			subtract_surface_opaque(output, item->surface, box, remaining);
+		} else {
+			// Decorations are painted with an opaque color
+			pixman_region32_t opaque;
+			pixman_region32_init_rect(&opaque, box->x, box->y, box->width,
+				box->height);
+			pixman_region32_subtract(remaining, remaining, &opaque);
+			pixman_region32_fini(&opaque);
+		}
+	}
+}
+
+static bool surface_is_opaque(struct wlr_surface *surface) {
+	pixman_box32_t box = {
+		.x2 = surface->current->width,
+		.y2 = surface->current->height,
+	};
+	return pixman_region32_contains_rectangle(&surface->current->opaque,
+		&box) == PIXMAN_REGION_IN;
+}
+
+/**
+ * Tries to display the largest opaque surface which isn't covered by anything
+ * else on a hardware overlay plane, so that it doesn't need to be rendered.
+ * The area below the previous overlay is added to `damage` when it stops being
+ * displayed.
+ */
+static void assign_overlay(struct roots_output *output, struct wl_array *items,
+		pixman_region32_t *damage) {
+	struct wlr_output *wlr_output = output->wlr_output;
+
+	pixman_region32_t above;
+	pixman_region32_init(&above);
+
+	struct render_item *list = items->data;
+	int nitems = items->size / sizeof(struct render_item);
+	struct render_item *best = NULL;
+	struct wlr_box best_box = {0};
+	for (int i = nitems - 1; i >= 0; --i) {
+		struct render_item *item = &list[i];
+		struct wlr_box *box = &item->box;
+
+		pixman_box32_t extents = {
+			.x1 = box->x,
+			.y1 = box->y,
+			.x2 = box->x + box->width,
+			.y2 = box->y + box->height,
+		};
+		// Only surfaces with a buffer the backend can display are candidates
+		if (item->surface != NULL && item->surface->buffer != NULL &&
+				item->rotation == 0 &&
+				box->width * box->height > best_box.width * best_box.height &&
+				surface_is_opaque(item->surface) &&
+				pixman_region32_contains_rectangle(&above, &extents) ==
+				PIXMAN_REGION_OUT) {
+			best = item;
+			best_box = *box;
+		}
+
+		pixman_region32_union_rect(&above, &above, item->bounds.x,
+			item->bounds.y, item->bounds.width, item->bounds.height);
+	}
+
+	pixman_region32_fini(&above);
+
+	if (best != NULL) {
+		best->overlay = wlr_output_set_overlay_surface(wlr_output,
+			best->surface, &best_box);
+	} else if (output->overlay_active) {
+		wlr_output_set_overlay_surface(wlr_output, NULL, NULL);
+	}
+
+	bool active = best != NULL && best->overlay;
+	struct wlr_box *prev = &output->overlay_box;
+	if (output->overlay_active && (!active || prev->x != best_box.x ||
+			prev->y != best_box.y || prev->width != best_box.width ||
+			prev->height != best_box.height)) {
+		// Buffers drawn while the overlay was up have a hole there, keep it in
+		// the damage history until all of them have been repainted
+		pixman_region32_union_rect(damage, damage, prev->x, prev->y,
+			prev->width, prev->height);
+		wlr_output_damage_add_box(output->damage, prev);
+	}
+
+	output->overlay_active = active;
+	if (active) {
+		output->overlay_box = best_box;
+	}
+}
+
+static void render_items(struct wl_array *items, struct render_data *data) {
+	pixman_region32_t *output_damage = data->damage;
+	struct render_item *item;
+	wl_array_for_each(item, items) {
+		if (item->overlay) {
+			wlr_surface_send_frame_done(item->surface, data->when);
+		} else if (pixman_region32_not_empty(&item->damage)) {
+			data->damage = &item->damage;
+			if (item->surface != NULL) {
+				render_surface(item, data);
+			} else {
+				render_decorations(item, data);
+			}
+		} else if (item->surface != NULL) {
+			// Culled surfaces still get frame events where the output is
+			// damaged, otherwise their clients would stall
+			pixman_box32_t extents = {
+				.x1 = item->bounds.x,
+				.y1 = item->bounds.y,
+				.x2 = item->bounds.x + item->bounds.width,
+				.y2 = item->bounds.y + item->bounds.height,
+			};
+			if (pixman_region32_contains_rectangle(output_damage, &extents) !=
+					PIXMAN_REGION_OUT) {
+				wlr_surface_send_frame_done(item->surface, data->when);
+			}
+		}
+		pixman_region32_fini(&item->damage);
+	}
+	data->damage = output_damage;
+}
+
+#ifdef WLR_HAS_XWAYLAND
+/**
+ * Checks whether an Xwayland view is a child of another one, or one of its
+ * descendants.
+ */
+static bool xwayland_view_is_descendant(struct roots_view *view,
+		struct roots_view *ancestor) {
+	if (view->type != ROOTS_XWAYLAND_VIEW ||
+			ancestor->type != ROOTS_XWAYLAND_VIEW) {
+		return false;
+	}
+	struct wlr_xwayland_surface *xsurface = view->xwayland_surface->parent;
+	while (xsurface != NULL) {
+		if (ancestor->xwayland_surface == xsurface) {
+			return true;
+		}
+		xsurface = xsurface->parent;
+	}
+	return false;
+}
+#endif
+
 static bool has_standalone_surface(struct roots_view *view) {
 	if (!wl_list_empty(&view->wlr_surface->subsurface_list)) {
 		return false;
@@ -415,55 +498,99 @@ static void render_output(struct roots_output *output) {
 		goto renderer_end;
 	}
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_renderer_clear(renderer, &clear_color);
-	}
-
-	// If a view is fullscreen on this output, render it
-	if (output->fullscreen_view != NULL) {
-		struct roots_view *view = output->fullscreen_view;
+	// If the output renders the fullscreen view, only clear the damage
+	if (output->fullscreen_view != NULL &&
+			wlr_output->fullscreen_surface ==
+			output->fullscreen_view->wlr_surface) {
+		if (output->overlay_active) {
+			struct wlr_box *prev = &output->overlay_box;
+			wlr_output_set_overlay_surface(wlr_output, NULL, NULL);
+			output->overlay_active = false;
+			pixman_region32_union_rect(&damage, &damage, prev->x, prev->y,
+				prev->width, prev->height);
+			wlr_output_damage_add_box(output->damage, prev);
+		}
 
-		if (wlr_output->fullscreen_surface == view->wlr_surface) {
-			// The output will render the fullscreen view
-			goto renderer_end;
+		int nrects;
+		pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+		for (int i = 0; i < nrects; ++i) {
+			scissor_output(output, &rects[i]);
+			wlr_renderer_clear(renderer, &clear_color);
 		}
+		goto renderer_end;
+	}
+
+	// Collect everything to paint, back to front. Only the scene nodes
+	// intersecting the output are visited.
+	struct wl_array items;
+	wl_array_init(&items);
+	struct collect_data collect = {
+		.output = output,
+		.output_box = wlr_output_layout_get_box(desktop->layout, wlr_output),
+		.items = &items,
+	};
 
-		view_for_each_surface(view, render_surface, &data);
+	if (collect.output_box == NULL) {
+		// Not in the layout, nothing to paint but the background
+	} else if (output->fullscreen_view != NULL) {
+		// If a view is fullscreen on this output, render it without
+		// decorations
+		struct roots_view *view = output->fullscreen_view;
+		view_update_scene(view);
+		wlr_scene_node_for_each_in_box(view->scene_node, collect.output_box,
+			collect_node, &collect);
 
-		// During normal rendering the xwayland window tree isn't traversed
-		// because all windows are rendered. Here we only want to render
-		// the fullscreen window's children so we have to traverse the tree.
+		// Xwayland children are views of their own, which are hidden by the
+		// fullscreen view unless rendered here
 #ifdef WLR_HAS_XWAYLAND
-		if (view->type == ROOTS_XWAYLAND_VIEW) {
-			xwayland_children_for_each_surface(view->xwayland_surface,
-				render_surface, &data);
+		struct roots_view *child;
+		wl_list_for_each_reverse(child, &desktop->views, link) {
+			if (xwayland_view_is_descendant(child, view)) {
+				view_update_scene(child);
+				wlr_scene_node_for_each_in_box(child->scene_node,
+					collect.output_box, collect_node, &collect);
+			}
 		}
 #endif
+	} else {
+		struct roots_view *view;
+		wl_list_for_each_reverse(view, &desktop->views, link) {
+			collect_view(view, &collect);
+		}
 
-		goto renderer_end;
+		struct roots_drag_icon *drag_icon = NULL;
+		struct roots_seat *seat = NULL;
+		wl_list_for_each(seat, &server->input->seats, link) {
+			wl_list_for_each(drag_icon, &seat->drag_icons, link) {
+				if (!drag_icon->wlr_drag_icon->mapped) {
+					continue;
+				}
+				wlr_scene_node_update(drag_icon->scene_node);
+				wlr_scene_node_for_each_in_box(drag_icon->scene_node,
+					collect.output_box, collect_node, &collect);
+			}
+		}
 	}
 
-	// Render all views
-	struct roots_view *view;
-	wl_list_for_each_reverse(view, &desktop->views, link) {
-		render_view(view, &data);
-	}
+	assign_overlay(output, &items, &damage);
 
-	// Render drag icons
-	struct roots_drag_icon *drag_icon = NULL;
-	struct roots_seat *seat = NULL;
-	wl_list_for_each(seat, &server->input->seats, link) {
-		wl_list_for_each(drag_icon, &seat->drag_icons, link) {
-			if (!drag_icon->wlr_drag_icon->mapped) {
-				continue;
-			}
-			render_surface(drag_icon->wlr_drag_icon->surface,
-				drag_icon->x, drag_icon->y, 0, &data);
-		}
+	// Skip everything hidden behind opaque surfaces, and only clear what isn't
+	// covered by one
+	pixman_region32_t background;
+	pixman_region32_init(&background);
+	pixman_region32_copy(&background, &damage);
+	compute_visible_damage(output, &items, &background);
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&background, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_output(output, &rects[i]);
+		wlr_renderer_clear(renderer, &clear_color);
 	}
+	pixman_region32_fini(&background);
+
+	render_items(&items, &data);
+	wl_array_release(&items);
 
 renderer_end:
 	wlr_renderer_scissor(renderer, NULL);
@@ -496,56 +623,36 @@ static bool view_accept_damage(struct roots_output *output,
 		return true;
 	}
 #ifdef WLR_HAS_XWAYLAND
-	if (output->fullscreen_view->type == ROOTS_XWAYLAND_VIEW &&
-			view->type == ROOTS_XWAYLAND_VIEW) {
-		// Special case: accept damage from children
-		struct wlr_xwayland_surface *xsurface = view->xwayland_surface;
-		while (xsurface != NULL) {
-			if (output->fullscreen_view->xwayland_surface == xsurface) {
-				return true;
-			}
-			xsurface = xsurface->parent;
-		}
+	// Special case: accept damage from children
+	if (xwayland_view_is_descendant(view, output->fullscreen_view)) {
+		return true;
 	}
 #endif
 	return false;
 }
 
-static void damage_whole_surface(struct wlr_surface *surface,
-		double lx, double ly, float rotation, void *data) {
-	struct roots_output *output = data;
-
-	if (!wlr_surface_has_buffer(surface)) {
-		return;
-	}
-
-	int ow, oh;
-	wlr_output_transformed_resolution(output->wlr_output, &ow, &oh);
-
-	struct wlr_box box;
-	bool intersects = surface_intersect_output(surface, output->desktop->layout,
-		output->wlr_output, lx, ly, rotation, &box);
-	if (!intersects) {
-		return;
-	}
-
-	wlr_box_rotated_bounds(&box, -rotation, &box);
+struct damage_data {
+	struct roots_output *output;
+	const struct wlr_box *output_box; // layout coordinates
+	struct roots_view *view; // NULL if decorations aren't damaged
+};
 
-	wlr_output_damage_add_box(output->damage, &box);
-}
+static void damage_whole_node(struct wlr_scene_node *node, void *_data) {
+	struct damage_data *data = _data;
+	struct roots_output *output = data->output;
 
-static void damage_whole_decoration(struct roots_view *view,
-		struct roots_output *output) {
-	if (!view->decorated || view->wlr_surface == NULL) {
+	if (node->surface != NULL) {
+		if (!wlr_surface_has_buffer(node->surface)) {
+			return;
+		}
+	} else if (data->view == NULL || node != data->view->deco_node) {
 		return;
 	}
 
-	struct wlr_box box;
-	get_decoration_box(view, output, &box);
-
-	wlr_box_rotated_bounds(&box, -view->rotation, &box);
-
-	wlr_output_damage_add_box(output->damage, &box);
+	struct wlr_box box, bounds;
+	scene_node_output_box(node, output, data->output_box, &box);
+	scene_node_output_bounds(node, output, data->output_box, &box, &bounds);
+	wlr_output_damage_add_box(output->damage, &bounds);
 }
 
 void output_damage_whole_view(struct roots_output *output,
@@ -554,33 +661,50 @@ void output_damage_whole_view(struct roots_output *output,
 		return;
 	}
 
-	damage_whole_decoration(view, output);
-	view_for_each_surface(view, damage_whole_surface, output);
+	struct damage_data data = {
+		.output = output,
+		.output_box = wlr_output_layout_get_box(output->desktop->layout,
+			output->wlr_output),
+		.view = view,
+	};
+	if (data.output_box == NULL) {
+		return;
+	}
+
+	wlr_scene_node_for_each_in_box(view->scene_node, data.output_box,
+		damage_whole_node, &data);
 }
 
 void output_damage_whole_drag_icon(struct roots_output *output,
 		struct roots_drag_icon *icon) {
-	surface_for_each_surface(icon->wlr_drag_icon->surface, icon->x, icon->y, 0,
-		damage_whole_surface, output);
+	struct damage_data data = {
+		.output = output,
+		.output_box = wlr_output_layout_get_box(output->desktop->layout,
+			output->wlr_output),
+	};
+	if (data.output_box == NULL) {
+		return;
+	}
+
+	wlr_scene_node_update(icon->scene_node);
+	wlr_scene_node_for_each_in_box(icon->scene_node, data.output_box,
+		damage_whole_node, &data);
 }
 
-static void damage_from_surface(struct wlr_surface *surface,
-		double lx, double ly, float rotation, void *data) {
-	struct roots_output *output = data;
+static void damage_from_node(struct wlr_scene_node *node, void *_data) {
+	struct damage_data *data = _data;
+	struct roots_output *output = data->output;
 	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_surface *surface = node->surface;
 
-	if (!wlr_surface_has_buffer(surface)) {
+	if (surface == NULL || !wlr_surface_has_buffer(surface)) {
 		return;
 	}
 
-	int ow, oh;
-	wlr_output_transformed_resolution(wlr_output, &ow, &oh);
-
 	struct wlr_box box;
-	surface_intersect_output(surface, output->desktop->layout,
-		wlr_output, lx, ly, rotation, &box);
+	scene_node_output_box(node, output, data->output_box, &box);
 
-	if (rotation == 0) {
+	if (node->layout.rotation == 0) {
 		pixman_region32_t damage;
 		pixman_region32_init(&damage);
 		pixman_region32_copy(&damage, &surface->current->surface_damage);
@@ -602,7 +726,8 @@ static void damage_from_surface(struct wlr_surface *surface,
 			.width = (extents->x2 - extents->x1) * wlr_output->scale,
 			.height = (extents->y2 - extents->y1) * wlr_output->scale,
 		};
-		wlr_box_rotated_bounds(&damage_box, -rotation, &damage_box);
+		wlr_box_rotated_bounds(&damage_box, -node->layout.rotation,
+			&damage_box);
 		wlr_output_damage_add_box(output->damage, &damage_box);
 	}
 }
@@ -613,7 +738,17 @@ void output_damage_from_view(struct roots_output *output,
 		return;
 	}
 
-	view_for_each_surface(view, damage_from_surface, output);
+	struct damage_data data = {
+		.output = output,
+		.output_box = wlr_output_layout_get_box(output->desktop->layout,
+			output->wlr_output),
+	};
+	if (data.output_box == NULL) {
+		return;
+	}
+
+	wlr_scene_node_for_each_in_box(view->scene_node, data.output_box,
+		damage_from_node, &data);
 }
 
 static void set_mode(struct wlr_output *output,
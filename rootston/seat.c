@@ -4,6 +4,7 @@
 #include <wayland-server.h>
 #include <wlr/config.h>
 #include <wlr/types/wlr_idle.h>
+#include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/util/log.h>
 #include "rootston/cursor.h"
@@ -175,6 +176,12 @@ void roots_seat_configure_cursor(struct roots_seat *seat) {
 	if (cc != NULL) {
 		mapped_output = cc->mapped_output;
 	}
+	struct wl_event_loop *motion_loop = NULL;
+	if (cc != NULL && cc->coalesce_motion) {
+		motion_loop =
+			wl_display_get_event_loop(seat->input->server->wl_display);
+	}
+	wlr_cursor_set_motion_coalescing(cursor, motion_loop);
 	wl_list_for_each(output, &desktop->outputs, link) {
 		if (mapped_output &&
 				strcmp(mapped_output, output->wlr_output->name) == 0) {
@@ -269,6 +276,7 @@ static void roots_drag_icon_handle_destroy(struct wl_listener *listener,
 	wl_list_remove(&icon->surface_commit.link);
 	wl_list_remove(&icon->map.link);
 	wl_list_remove(&icon->destroy.link);
+	wlr_scene_node_destroy(icon->scene_node);
 	free(icon);
 }
 
@@ -283,6 +291,11 @@ static void roots_seat_handle_new_drag_icon(struct wl_listener *listener,
 	}
 	icon->seat = seat;
 	icon->wlr_drag_icon = wlr_drag_icon;
+	icon->scene_node = wlr_scene_surface_create(NULL, wlr_drag_icon->surface);
+	if (icon->scene_node == NULL) {
+		free(icon);
+		return;
+	}
 
 	icon->surface_commit.notify = roots_drag_icon_handle_surface_commit;
 	wl_signal_add(&wlr_drag_icon->surface->events.commit, &icon->surface_commit);
@@ -312,6 +325,7 @@ void roots_drag_icon_update_position(struct roots_drag_icon *icon) {
 		icon->x = seat->touch_x + wlr_icon->sx;
 		icon->y = seat->touch_y + wlr_icon->sy;
 	}
+	wlr_scene_node_set_position(icon->scene_node, icon->x, icon->y);
 
 	roots_drag_icon_damage_whole(icon);
 }
@@ -711,7 +725,7 @@ void roots_seat_set_focus(struct roots_seat *seat, struct roots_view *view) {
 	// already focused in this seat
 	if (view != NULL) {
 		wl_list_remove(&view->link);
-		wl_list_insert(&seat->input->server->desktop->views, &view->link);
+		desktop_insert_view(seat->input->server->desktop, view);
 	}
 
 	struct roots_view *prev_focus = roots_seat_get_focus(seat);
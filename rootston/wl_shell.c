@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <wayland-server.h>
 #include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/types/wlr_wl_shell.h>
 #include <wlr/util/log.h>
@@ -35,26 +36,39 @@ static void popup_handle_set_state(struct wl_listener *listener, void *data) {
 	popup_destroy((struct roots_view_child *)popup);
 }
 
+static void popup_update_scene(struct roots_view_child *child) {
+	struct roots_wl_shell_popup *popup = (struct roots_wl_shell_popup *)child;
+	struct wlr_wl_shell_surface_transient_state *transient_state =
+		popup->wlr_wl_shell_surface->transient_state;
+	wlr_scene_node_set_position(child->scene_node, transient_state->x,
+		transient_state->y);
+}
+
 static struct roots_wl_shell_popup *popup_create(struct roots_view *view,
-	struct wlr_wl_shell_surface *wlr_wl_shell_surface);
+	struct wlr_wl_shell_surface *wlr_wl_shell_surface,
+	struct wlr_scene_node *parent_node);
 
 static void popup_handle_new_popup(struct wl_listener *listener, void *data) {
 	struct roots_wl_shell_popup *popup =
 		wl_container_of(listener, popup, new_popup);
 	struct wlr_wl_shell_surface *wlr_wl_shell_surface = data;
-	popup_create(popup->view_child.view, wlr_wl_shell_surface);
+	popup_create(popup->view_child.view, wlr_wl_shell_surface,
+		popup->view_child.scene_node);
 }
 
 static struct roots_wl_shell_popup *popup_create(struct roots_view *view,
-		struct wlr_wl_shell_surface *wlr_wl_shell_surface) {
+		struct wlr_wl_shell_surface *wlr_wl_shell_surface,
+		struct wlr_scene_node *parent_node) {
 	struct roots_wl_shell_popup *popup =
 		calloc(1, sizeof(struct roots_wl_shell_popup));
 	if (popup == NULL) {
 		return NULL;
 	}
 	popup->wlr_wl_shell_surface = wlr_wl_shell_surface;
+	popup->view_child.update_scene = popup_update_scene;
 	popup->view_child.destroy = popup_destroy;
 	view_child_init(&popup->view_child, view, wlr_wl_shell_surface->surface);
+	view_child_create_scene_node(&popup->view_child, parent_node);
 	popup->destroy.notify = popup_handle_destroy;
 	wl_signal_add(&wlr_wl_shell_surface->events.destroy, &popup->destroy);
 	popup->set_state.notify = popup_handle_set_state;
@@ -168,7 +182,8 @@ static void handle_new_popup(struct wl_listener *listener, void *data) {
 	struct roots_wl_shell_surface *roots_surface =
 		wl_container_of(listener, roots_surface, new_popup);
 	struct wlr_wl_shell_surface *wlr_wl_shell_surface = data;
-	popup_create(roots_surface->view, wlr_wl_shell_surface);
+	struct roots_view *view = roots_surface->view;
+	popup_create(view, wlr_wl_shell_surface, view->surface_node);
 }
 
 static void handle_destroy(struct wl_listener *listener, void *data) {
@@ -243,7 +258,7 @@ void handle_wl_shell_surface(struct wl_listener *listener, void *data) {
 	view->close = close;
 	roots_surface->view = view;
 	view_init(view, desktop);
-	wl_list_insert(&desktop->views, &view->link);
+	desktop_insert_view(desktop, view);
 
 	view_setup(view);
 
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <wayland-server.h>
 #include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/types/wlr_xdg_shell_v6.h>
 #include <wlr/util/log.h>
@@ -28,26 +29,39 @@ static void popup_handle_destroy(struct wl_listener *listener, void *data) {
 	popup_destroy((struct roots_view_child *)popup);
 }
 
+static void popup_update_scene(struct roots_view_child *child) {
+	struct roots_xdg_popup_v6 *popup = (struct roots_xdg_popup_v6 *)child;
+	struct wlr_xdg_surface_v6 *surface = popup->wlr_popup->base;
+	double popup_sx, popup_sy;
+	wlr_xdg_surface_v6_popup_get_position(surface, &popup_sx, &popup_sy);
+	wlr_scene_node_set_position(child->scene_node, popup_sx, popup_sy);
+	wlr_scene_node_set_enabled(child->scene_node, surface->configured);
+}
+
 static struct roots_xdg_popup_v6 *popup_create(struct roots_view *view,
-	struct wlr_xdg_popup_v6 *wlr_popup);
+	struct wlr_xdg_popup_v6 *wlr_popup, struct wlr_scene_node *parent_node);
 
 static void popup_handle_new_popup(struct wl_listener *listener, void *data) {
 	struct roots_xdg_popup_v6 *popup =
 		wl_container_of(listener, popup, new_popup);
 	struct wlr_xdg_popup_v6 *wlr_popup = data;
-	popup_create(popup->view_child.view, wlr_popup);
+	popup_create(popup->view_child.view, wlr_popup,
+		popup->view_child.scene_node);
 }
 
 static struct roots_xdg_popup_v6 *popup_create(struct roots_view *view,
-		struct wlr_xdg_popup_v6 *wlr_popup) {
+		struct wlr_xdg_popup_v6 *wlr_popup,
+		struct wlr_scene_node *parent_node) {
 	struct roots_xdg_popup_v6 *popup =
 		calloc(1, sizeof(struct roots_xdg_popup_v6));
 	if (popup == NULL) {
 		return NULL;
 	}
 	popup->wlr_popup = wlr_popup;
+	popup->view_child.update_scene = popup_update_scene;
 	popup->view_child.destroy = popup_destroy;
 	view_child_init(&popup->view_child, view, wlr_popup->base->surface);
+	view_child_create_scene_node(&popup->view_child, parent_node);
 	popup->destroy.notify = popup_handle_destroy;
 	wl_signal_add(&wlr_popup->base->events.destroy, &popup->destroy);
 	popup->new_popup.notify = popup_handle_new_popup;
@@ -274,7 +288,8 @@ static void handle_new_popup(struct wl_listener *listener, void *data) {
 	struct roots_xdg_surface_v6 *roots_xdg_surface =
 		wl_container_of(listener, roots_xdg_surface, new_popup);
 	struct wlr_xdg_popup_v6 *wlr_popup = data;
-	popup_create(roots_xdg_surface->view, wlr_popup);
+	struct roots_view *view = roots_xdg_surface->view;
+	popup_create(view, wlr_popup, view->surface_node);
 }
 
 static void handle_destroy(struct wl_listener *listener, void *data) {
@@ -357,7 +372,7 @@ void handle_xdg_shell_v6_surface(struct wl_listener *listener, void *data) {
 	view->height = box.height;
 
 	view_init(view, desktop);
-	wl_list_insert(&desktop->views, &view->link);
+	desktop_insert_view(desktop, view);
 
 	view_setup(view);
 }
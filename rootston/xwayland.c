@@ -4,6 +4,7 @@
 #include <wayland-server.h>
 #include <wlr/config.h>
 #include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/util/log.h>
 #include <wlr/xwayland.h>
@@ -238,7 +239,7 @@ static void handle_map_notify(struct wl_listener *listener, void *data) {
 	view->y = xsurface->y;
 	view->width = xsurface->surface->current->width;
 	view->height = xsurface->surface->current->height;
-	wl_list_insert(&desktop->views, &view->link);
+	desktop_insert_view(desktop, view);
 
 	struct wlr_subsurface *subsurface;
 	wl_list_for_each(subsurface, &view->wlr_surface->subsurface_list,
@@ -246,6 +247,10 @@ static void handle_map_notify(struct wl_listener *listener, void *data) {
 		subsurface_create(view, subsurface);
 	}
 
+	wlr_scene_node_destroy(view->surface_node);
+	view->surface_node =
+		wlr_scene_surface_create(view->scene_node, view->wlr_surface);
+
 	view_damage_whole(view);
 
 	roots_surface->surface_commit.notify = handle_surface_commit;
@@ -273,9 +278,14 @@ static void handle_unmap_notify(struct wl_listener *listener, void *data) {
 		view->fullscreen_output = NULL;
 	}
 
+	wlr_scene_node_destroy(view->surface_node);
+	view->surface_node = NULL;
+
 	view->wlr_surface = NULL;
 	view->width = view->height = 0;
 	wl_list_remove(&view->link);
+	// Drop the view from the index
+	view_update_scene(view);
 }
 
 void handle_xwayland_surface(struct wl_listener *listener, void *data) {
@@ -340,7 +350,7 @@ void handle_xwayland_surface(struct wl_listener *listener, void *data) {
 	view->close = close;
 	roots_surface->view = view;
 	view_init(view, desktop);
-	wl_list_insert(&desktop->views, &view->link);
+	desktop_insert_view(desktop, view);
 
 	if (!surface->override_redirect) {
 		if (surface->decorations == WLR_XWAYLAND_SURFACE_DECORATIONS_ALL) {
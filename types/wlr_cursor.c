@@ -53,6 +53,12 @@ struct wlr_cursor_state {
 	struct wl_listener layout_add;
 	struct wl_listener layout_change;
 	struct wl_listener layout_destroy;
+
+	// Relative motion coalescing, enabled if motion_loop isn't NULL
+	struct wl_event_loop *motion_loop;
+	struct wl_event_source *motion_idle;
+	struct wlr_event_pointer_motion pending_motion;
+	bool motion_pending;
 };
 
 struct wlr_cursor *wlr_cursor_create() {
@@ -125,8 +131,45 @@ static void wlr_cursor_detach_output_layout(struct wlr_cursor *cur) {
 	cur->state->layout = NULL;
 }
 
+static void cursor_flush_motion(struct wlr_cursor *cur) {
+	struct wlr_cursor_state *state = cur->state;
+	if (!state->motion_pending) {
+		return;
+	}
+	state->motion_pending = false;
+
+	struct wlr_event_pointer_motion event = state->pending_motion;
+	wlr_signal_emit_safe(&cur->events.motion, &event);
+}
+
+static void handle_motion_idle(void *data) {
+	struct wlr_cursor *cur = data;
+	cur->state->motion_idle = NULL;
+	cursor_flush_motion(cur);
+}
+
+void wlr_cursor_set_motion_coalescing(struct wlr_cursor *cur,
+		struct wl_event_loop *loop) {
+	struct wlr_cursor_state *state = cur->state;
+	if (state->motion_loop == loop) {
+		return;
+	}
+
+	cursor_flush_motion(cur);
+	if (state->motion_idle != NULL) {
+		wl_event_source_remove(state->motion_idle);
+		state->motion_idle = NULL;
+	}
+	state->motion_loop = loop;
+}
+
 static void wlr_cursor_device_destroy(struct wlr_cursor_device *c_device) {
 	struct wlr_input_device *dev = c_device->device;
+	struct wlr_cursor_state *state = c_device->cursor->state;
+	if (state->motion_pending && state->pending_motion.device == dev) {
+		cursor_flush_motion(c_device->cursor);
+	}
+
 	if (dev->type == WLR_INPUT_DEVICE_POINTER) {
 		wl_list_remove(&c_device->motion.link);
 		wl_list_remove(&c_device->motion_absolute.link);
@@ -157,6 +200,9 @@ void wlr_cursor_destroy(struct wlr_cursor *cur) {
 		wlr_cursor_device_destroy(device);
 	}
 
+	if (cur->state->motion_idle != NULL) {
+		wl_event_source_remove(cur->state->motion_idle);
+	}
 	free(cur->state);
 	free(cur);
 }
@@ -326,7 +372,36 @@ static void handle_pointer_motion(struct wl_listener *listener, void *data) {
 	struct wlr_event_pointer_motion *event = data;
 	struct wlr_cursor_device *device =
 		wl_container_of(listener, device, motion);
-	wlr_signal_emit_safe(&device->cursor->events.motion, event);
+	struct wlr_cursor *cur = device->cursor;
+	struct wlr_cursor_state *state = cur->state;
+	if (state->motion_loop == NULL) {
+		wlr_signal_emit_safe(&cur->events.motion, event);
+		return;
+	}
+
+	// Accumulate deltas until the event loop is idle, so that a burst of
+	// events from a high-rate pointer is only processed once
+	if (state->motion_pending &&
+			state->pending_motion.device != event->device) {
+		cursor_flush_motion(cur);
+	}
+	if (state->motion_pending) {
+		state->pending_motion.time_msec = event->time_msec;
+		state->pending_motion.delta_x += event->delta_x;
+		state->pending_motion.delta_y += event->delta_y;
+	} else {
+		state->pending_motion = *event;
+		state->motion_pending = true;
+	}
+
+	if (state->motion_idle == NULL) {
+		state->motion_idle = wl_event_loop_add_idle(state->motion_loop,
+			handle_motion_idle, cur);
+		if (state->motion_idle == NULL) {
+			wlr_log(L_ERROR, "Failed to add idle event source");
+			cursor_flush_motion(cur);
+		}
+	}
 }
 
 static void handle_pointer_motion_absolute(struct wl_listener *listener,
@@ -334,6 +409,7 @@ static void handle_pointer_motion_absolute(struct wl_listener *listener,
 	struct wlr_event_pointer_motion_absolute *event = data;
 	struct wlr_cursor_device *device =
 		wl_container_of(listener, device, motion_absolute);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.motion_absolute, event);
 }
 
@@ -341,12 +417,14 @@ static void handle_pointer_button(struct wl_listener *listener, void *data) {
 	struct wlr_event_pointer_button *event = data;
 	struct wlr_cursor_device *device =
 		wl_container_of(listener, device, button);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.button, event);
 }
 
 static void handle_pointer_axis(struct wl_listener *listener, void *data) {
 	struct wlr_event_pointer_axis *event = data;
 	struct wlr_cursor_device *device = wl_container_of(listener, device, axis);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.axis, event);
 }
 
@@ -354,6 +432,7 @@ static void handle_touch_up(struct wl_listener *listener, void *data) {
 	struct wlr_event_touch_up *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_up);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.touch_up, event);
 }
 
@@ -361,6 +440,7 @@ static void handle_touch_down(struct wl_listener *listener, void *data) {
 	struct wlr_event_touch_down *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_down);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.touch_down, event);
 }
 
@@ -368,6 +448,7 @@ static void handle_touch_motion(struct wl_listener *listener, void *data) {
 	struct wlr_event_touch_motion *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_motion);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.touch_motion, event);
 }
 
@@ -375,6 +456,7 @@ static void handle_touch_cancel(struct wl_listener *listener, void *data) {
 	struct wlr_event_touch_cancel *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, touch_cancel);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.touch_cancel, event);
 }
 
@@ -382,6 +464,7 @@ static void handle_tablet_tool_tip(struct wl_listener *listener, void *data) {
 	struct wlr_event_tablet_tool_tip *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_tip);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.tablet_tool_tip, event);
 }
 
@@ -389,6 +472,7 @@ static void handle_tablet_tool_axis(struct wl_listener *listener, void *data) {
 	struct wlr_event_tablet_tool_axis *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_axis);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.tablet_tool_axis, event);
 }
 
@@ -397,6 +481,7 @@ static void handle_tablet_tool_button(struct wl_listener *listener,
 	struct wlr_event_tablet_tool_button *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_button);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.tablet_tool_button, event);
 }
 
@@ -405,6 +490,7 @@ static void handle_tablet_tool_proximity(struct wl_listener *listener,
 	struct wlr_event_tablet_tool_proximity *event = data;
 	struct wlr_cursor_device *device;
 	device = wl_container_of(listener, device, tablet_tool_proximity);
+	cursor_flush_motion(device->cursor);
 	wlr_signal_emit_safe(&device->cursor->events.tablet_tool_proximity, event);
 }
 
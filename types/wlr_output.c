@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <tgmath.h>
@@ -15,6 +16,10 @@
 #include <wlr/util/region.h>
 #include "util/signal.h"
 
+// Safety margin between the end of rendering and vblank, in nanoseconds
+#define FRAME_MARGIN_INIT 2000000
+#define FRAME_MARGIN_MIN 1000000
+
 static void wl_output_send_to_resource(struct wl_resource *resource) {
 	assert(resource);
 	struct wlr_output *output = wl_resource_get_user_data(resource);
@@ -188,6 +193,9 @@ void wlr_output_update_custom_mode(struct wlr_output *output, int32_t width,
 	wlr_output_update_matrix(output);
 
 	output->refresh = refresh;
+	// Previous presentation times don't predict vblanks for the new mode
+	output->last_present = 0;
+	output->frame_target = 0;
 
 	struct wl_resource *resource;
 	wl_resource_for_each(resource, &output->wl_resources) {
@@ -274,6 +282,8 @@ void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
 	wl_display_add_destroy_listener(display, &output->display_destroy);
 
 	output->frame_pending = true;
+	output->frame_margin = FRAME_MARGIN_INIT;
+	output->scanout_rendered_frames = INT_MAX;
 }
 
 void wlr_output_destroy(struct wlr_output *output) {
@@ -300,6 +310,15 @@ void wlr_output_destroy(struct wlr_output *output) {
 
 	pixman_region32_fini(&output->damage);
 
+	if (output->idle_frame != NULL) {
+		wl_event_source_remove(output->idle_frame);
+	}
+	if (output->frame_timer != NULL) {
+		wl_event_source_remove(output->frame_timer);
+	}
+	wlr_render_timer_destroy(output->gpu_timers[0]);
+	wlr_render_timer_destroy(output->gpu_timers[1]);
+
 	if (output->impl && output->impl->destroy) {
 		output->impl->destroy(output);
 	} else {
@@ -325,8 +344,42 @@ void wlr_output_effective_resolution(struct wlr_output *output,
 	*height /= output->scale;
 }
 
+static void output_begin_gpu_timer(struct wlr_output *output) {
+	if (output->gpu_timer_unsupported) {
+		return;
+	}
+	if (output->gpu_timers[0] == NULL) {
+		struct wlr_renderer *renderer =
+			wlr_backend_get_renderer(output->backend);
+		for (size_t i = 0; renderer != NULL && i < 2; ++i) {
+			output->gpu_timers[i] = wlr_render_timer_create(renderer);
+		}
+		if (output->gpu_timers[0] == NULL || output->gpu_timers[1] == NULL) {
+			wlr_render_timer_destroy(output->gpu_timers[0]);
+			wlr_render_timer_destroy(output->gpu_timers[1]);
+			output->gpu_timers[0] = output->gpu_timers[1] = NULL;
+			output->gpu_timer_unsupported = true;
+			return;
+		}
+	}
+	wlr_render_timer_begin(output->gpu_timers[0]);
+	output->gpu_timer_running = true;
+}
+
 bool wlr_output_make_current(struct wlr_output *output, int *buffer_age) {
-	return output->impl->make_current(output, buffer_age);
+	if (!output->impl->make_current(output, buffer_age)) {
+		return false;
+	}
+	if (buffer_age != NULL &&
+			*buffer_age > output->scanout_rendered_frames) {
+		// The buffer contents predate a direct scanout, the damage history
+		// doesn't describe them anymore
+		*buffer_age = 0;
+	}
+	if (output->frame_emitting && !output->gpu_timer_running) {
+		output_begin_gpu_timer(output);
+	}
+	return true;
 }
 
 static void output_scissor(struct wlr_output *output, pixman_box32_t *rect) {
@@ -460,6 +513,144 @@ surface_damage_finish:
 	pixman_region32_fini(&surface_damage);
 }
 
+/**
+ * Tries to display the fullscreen surface buffer without compositing it. This
+ * is only possible if the buffer covers the whole output as-is and nothing
+ * needs to be rendered on top of it.
+ */
+static bool output_fullscreen_surface_scanout(struct wlr_output *output,
+		struct wlr_surface *surface) {
+	if (output->impl->scanout_buffer == NULL ||
+			output->direct_scanout_locks > 0) {
+		return false;
+	}
+
+	// Only buffers which aren't copied on commit are kept by the surface
+	struct wlr_surface_state *state = surface->current;
+	if (surface->buffer == NULL || surface->buffer->resource == NULL) {
+		return false;
+	}
+	if (state->transform != output->transform ||
+			(float)state->scale != output->scale ||
+			state->buffer_width != output->width ||
+			state->buffer_height != output->height) {
+		return false;
+	}
+
+	struct wlr_output_cursor *cursor;
+	wl_list_for_each(cursor, &output->cursors, link) {
+		if (cursor->enabled && cursor->visible &&
+				output->hardware_cursor != cursor) {
+			return false;
+		}
+	}
+
+	return output->impl->scanout_buffer(output, surface->buffer);
+}
+
+static int64_t timespec_to_nsec(const struct timespec *ts) {
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static int64_t get_current_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
+
+static int64_t output_refresh_period(struct wlr_output *output) {
+	if (output->refresh <= 0) {
+		return 0;
+	}
+	return 1000000000000 / output->refresh;
+}
+
+static struct wlr_output_frame_timing *output_get_frame_timing(
+		struct wlr_output *output, uint64_t seq) {
+	if (seq == 0 || seq > output->timing_seq ||
+			output->timing_seq - seq >= WLR_OUTPUT_TIMING_LEN) {
+		return NULL;
+	}
+	return &output->timings[seq % WLR_OUTPUT_TIMING_LEN];
+}
+
+/**
+ * Stores the GPU time of the previous frame, if available.
+ */
+static void output_collect_gpu_timer(struct wlr_output *output) {
+	int64_t duration;
+	if (output->gpu_timer_seq == 0 ||
+			!wlr_render_timer_get_duration(output->gpu_timers[1], &duration)) {
+		return;
+	}
+	struct wlr_output_frame_timing *timing =
+		output_get_frame_timing(output, output->gpu_timer_seq);
+	if (timing != NULL) {
+		timing->gpu_time = duration;
+	}
+	output->gpu_timer_seq = 0;
+}
+
+static uint32_t region_area(pixman_region32_t *region) {
+	uint32_t area = 0;
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		area += (rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+	}
+	return area;
+}
+
+/**
+ * Records timing statistics for the frame that has just been submitted, and
+ * updates the render time estimate. Slow frames are accounted for immediately,
+ * fast ones slowly lower the estimate.
+ */
+static void output_record_frame(struct wlr_output *output,
+		pixman_region32_t *damage, bool scanout) {
+	int64_t now = get_current_time_nsec();
+	uint64_t seq = ++output->timing_seq;
+	struct wlr_output_frame_timing *timing =
+		&output->timings[seq % WLR_OUTPUT_TIMING_LEN];
+	*timing = (struct wlr_output_frame_timing){
+		.seq = seq,
+		.swap_time = now,
+		.render_time = -1,
+		.gpu_time = -1,
+		.present_latency = -1,
+		.damage_area = region_area(damage),
+		.scanout = scanout,
+	};
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	if (renderer != NULL) {
+		timing->draw_calls = wlr_renderer_get_draw_calls(renderer);
+	}
+	output->present_seq = seq;
+
+	if (output->frame_start != 0) {
+		int64_t render_time = now - output->frame_start;
+		timing->render_time = render_time;
+		if (render_time > output->render_time) {
+			output->render_time = render_time;
+		} else {
+			output->render_time -= (output->render_time - render_time) / 8;
+		}
+		output->frame_start = 0;
+	}
+
+	if (output->gpu_timer_running) {
+		wlr_render_timer_end(output->gpu_timers[0]);
+		output->gpu_timer_running = false;
+
+		// The previous result is dropped if it still isn't available
+		output_collect_gpu_timer(output);
+		struct wlr_render_timer *tmp = output->gpu_timers[1];
+		output->gpu_timers[1] = output->gpu_timers[0];
+		output->gpu_timers[0] = tmp;
+		output->gpu_timer_seq = seq;
+	}
+}
+
 bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 		pixman_region32_t *damage) {
 	if (output->frame_pending) {
@@ -470,8 +661,10 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 		wl_event_source_remove(output->idle_frame);
 		output->idle_frame = NULL;
 	}
-
-	wlr_signal_emit_safe(&output->events.swap_buffers, damage);
+	if (output->frame_timer_pending) {
+		wl_event_source_timer_update(output->frame_timer, 0);
+		output->frame_timer_pending = false;
+	}
 
 	int width, height;
 	wlr_output_transformed_resolution(output, &width, &height);
@@ -491,6 +684,21 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 		when = &now;
 	}
 
+	if (output->fullscreen_surface != NULL && output_fullscreen_surface_scanout(
+			output, output->fullscreen_surface)) {
+		wlr_surface_send_frame_done(output->fullscreen_surface, when);
+		output->fullscreen_scanout = true;
+		output->scanout_rendered_frames = 0;
+		output->frame_pending = true;
+		output->needs_swap = false;
+		pixman_region32_clear(&output->damage);
+		output_record_frame(output, &render_damage, true);
+		pixman_region32_fini(&render_damage);
+		return true;
+	}
+
+	output->fullscreen_scanout = false;
+
 	if (pixman_region32_not_empty(&render_damage)) {
 		if (output->fullscreen_surface != NULL) {
 			output_fullscreen_surface_render(output, output->fullscreen_surface,
@@ -507,6 +715,9 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 		}
 	}
 
+	// The output buffer now holds the whole frame
+	wlr_signal_emit_safe(&output->events.swap_buffers, damage);
+
 	// Transform damage into renderer coordinates, ie. upside down
 	enum wl_output_transform transform = wlr_output_transform_compose(
 		wlr_output_transform_invert(output->transform),
@@ -521,14 +732,124 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 	output->frame_pending = true;
 	output->needs_swap = false;
 	pixman_region32_clear(&output->damage);
+	if (output->scanout_rendered_frames < INT_MAX) {
+		output->scanout_rendered_frames++;
+	}
 
+	output_record_frame(output, &render_damage, false);
 	pixman_region32_fini(&render_damage);
 	return true;
 }
 
 void wlr_output_send_frame(struct wlr_output *output) {
 	output->frame_pending = false;
+	output->frame_start = get_current_time_nsec();
+	output->frame_emitting = true;
 	wlr_signal_emit_safe(&output->events.frame, output);
+	output->frame_emitting = false;
+
+	if (output->gpu_timer_running) {
+		// Nothing has been submitted, discard the measurement
+		wlr_render_timer_end(output->gpu_timers[0]);
+		output->gpu_timer_running = false;
+	}
+}
+
+static int schedule_frame_handle_timer(void *data) {
+	struct wlr_output *output = data;
+	output->frame_timer_pending = false;
+	if (!output->frame_pending) {
+		wlr_output_send_frame(output);
+	}
+	return 0;
+}
+
+/**
+ * Predicts the next vblank and arms the frame timer so that the frame event is
+ * sent just early enough to render for it. Returns false if the frame event
+ * should be sent right away, because vblank timing is unknown or there isn't
+ * enough time left.
+ */
+static bool output_schedule_frame_before_vblank(struct wlr_output *output) {
+	output->frame_target = 0;
+	int64_t period = output_refresh_period(output);
+	if (period == 0 || output->last_present == 0) {
+		return false;
+	}
+
+	int64_t now = get_current_time_nsec();
+	int64_t vblank = output->last_present + period;
+	if (vblank <= now) {
+		vblank += ((now - vblank) / period + 1) * period;
+	}
+	output->frame_target = vblank;
+
+	int64_t deadline = vblank - output->render_time - output->frame_margin;
+	int delay = deadline > now ? (deadline - now) / 1000000 : 0;
+	if (delay == 0) {
+		return false;
+	}
+
+	if (output->frame_timer == NULL) {
+		struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+		output->frame_timer =
+			wl_event_loop_add_timer(ev, schedule_frame_handle_timer, output);
+		if (output->frame_timer == NULL) {
+			return false;
+		}
+	}
+	wl_event_source_timer_update(output->frame_timer, delay);
+	output->frame_timer_pending = true;
+	return true;
+}
+
+/**
+ * Adapts the safety margin depending on whether the last frame made it in time
+ * for the vblank it was rendered for. Returns true if it didn't.
+ */
+static bool output_update_frame_margin(struct wlr_output *output,
+		int64_t present) {
+	int64_t period = output_refresh_period(output);
+	if (output->frame_target == 0 || period == 0) {
+		return false;
+	}
+
+	bool missed = present > output->frame_target + period / 2;
+	if (missed) {
+		// Missed the vblank, back off quickly
+		output->frame_margin *= 2;
+		if (output->frame_margin > period) {
+			output->frame_margin = period;
+		}
+	} else {
+		output->frame_margin -= output->frame_margin / 16;
+		if (output->frame_margin < FRAME_MARGIN_MIN) {
+			output->frame_margin = FRAME_MARGIN_MIN;
+		}
+	}
+	output->frame_target = 0;
+	return missed;
+}
+
+void wlr_output_send_present(struct wlr_output *output, struct timespec *when) {
+	int64_t present =
+		when != NULL ? timespec_to_nsec(when) : get_current_time_nsec();
+	bool missed = output_update_frame_margin(output, present);
+	output->last_present = present;
+
+	struct wlr_output_frame_timing *timing =
+		output_get_frame_timing(output, output->present_seq);
+	if (timing != NULL) {
+		timing->present_latency = present - timing->swap_time;
+		timing->missed_vblank = missed;
+	}
+	output->present_seq = 0;
+	output_collect_gpu_timer(output);
+
+	output->frame_pending = false;
+	if (!output_schedule_frame_before_vblank(output)) {
+		wlr_output_send_frame(output);
+	}
 }
 
 static void schedule_frame_handle_idle_timer(void *data) {
@@ -540,16 +861,30 @@ static void schedule_frame_handle_idle_timer(void *data) {
 }
 
 void wlr_output_schedule_frame(struct wlr_output *output) {
-	if (output->frame_pending || output->idle_frame != NULL) {
+	if (output->frame_pending || output->idle_frame != NULL ||
+			output->frame_timer_pending) {
+		return;
+	}
+
+	if (output_schedule_frame_before_vblank(output)) {
 		return;
 	}
 
-	// TODO: ask the backend to send a frame event when appropriate instead
 	struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
 	output->idle_frame =
 		wl_event_loop_add_idle(ev, schedule_frame_handle_idle_timer, output);
 }
 
+size_t wlr_output_get_frame_timings(struct wlr_output *output,
+		struct wlr_output_frame_timing *timings, size_t len) {
+	size_t n = 0;
+	for (uint64_t seq = output->timing_seq;
+			seq > 0 && n < len && n < WLR_OUTPUT_TIMING_LEN; --seq) {
+		timings[n++] = output->timings[seq % WLR_OUTPUT_TIMING_LEN];
+	}
+	return n;
+}
+
 void wlr_output_set_gamma(struct wlr_output *output,
 	uint32_t size, uint16_t *r, uint16_t *g, uint16_t *b) {
 	if (output->impl->set_gamma) {
@@ -624,8 +959,6 @@ static void output_fullscreen_surface_handle_destroy(
 
 void wlr_output_set_fullscreen_surface(struct wlr_output *output,
 		struct wlr_surface *surface) {
-	// TODO: hardware fullscreen
-
 	if (output->fullscreen_surface == surface) {
 		return;
 	}
@@ -648,6 +981,62 @@ void wlr_output_set_fullscreen_surface(struct wlr_output *output,
 		&output->fullscreen_surface_destroy);
 }
 
+bool wlr_output_set_overlay_surface(struct wlr_output *output,
+		struct wlr_surface *surface, const struct wlr_box *box) {
+	if (output->impl->set_overlay == NULL) {
+		return surface == NULL;
+	}
+	if (surface == NULL) {
+		return output->impl->set_overlay(output, NULL, NULL);
+	}
+
+	int width, height;
+	wlr_output_transformed_resolution(output, &width, &height);
+
+	bool ok = output->direct_scanout_locks == 0;
+	// Only buffers which aren't copied on commit are kept by the surface
+	if (surface->buffer == NULL || surface->buffer->resource == NULL ||
+			surface->current->transform != output->transform) {
+		ok = false;
+	}
+	if (box->x < 0 || box->y < 0 || box->x + box->width > width ||
+			box->y + box->height > height) {
+		ok = false;
+	}
+
+	// Software cursors are rendered in the output buffer, below the overlay
+	struct wlr_output_cursor *cursor;
+	wl_list_for_each(cursor, &output->cursors, link) {
+		if (cursor->enabled && cursor->visible &&
+				output->hardware_cursor != cursor) {
+			ok = false;
+		}
+	}
+
+	if (!ok) {
+		output->impl->set_overlay(output, NULL, NULL);
+		return false;
+	}
+
+	// Overlay planes are positioned in the untransformed output buffer
+	struct wlr_box plane_box;
+	wlr_box_transform(box, wlr_output_transform_invert(output->transform),
+		width, height, &plane_box);
+	return output->impl->set_overlay(output, surface->buffer, &plane_box);
+}
+
+void wlr_output_lock_direct_scanout(struct wlr_output *output, bool lock) {
+	if (lock) {
+		if (output->direct_scanout_locks++ == 0) {
+			// The output buffer may be stale below client buffers displayed
+			// so far, repaint it fully
+			output_damage_whole(output);
+		}
+	} else {
+		assert(output->direct_scanout_locks > 0);
+		output->direct_scanout_locks--;
+	}
+}
 
 static void output_cursor_damage_whole(struct wlr_output_cursor *cursor) {
 	struct wlr_box box;
@@ -5,6 +5,7 @@
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/util/region.h>
 #include "util/signal.h"
 
 static void output_handle_destroy(struct wl_listener *listener, void *data) {
@@ -58,11 +59,21 @@ struct wlr_output_damage *wlr_output_damage_create(struct wlr_output *output) {
 	}
 
 	output_damage->output = output;
+	output_damage->rect_cost = WLR_OUTPUT_DAMAGE_RECT_COST;
+	output_damage->max_rects = WLR_OUTPUT_DAMAGE_MAX_RECTS;
 	wl_signal_init(&output_damage->events.frame);
 	wl_signal_init(&output_damage->events.destroy);
 
 	pixman_region32_init(&output_damage->current);
-	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_LEN; ++i) {
+	output_damage->previous_len = WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
+	output_damage->previous =
+		calloc(output_damage->previous_len, sizeof(pixman_region32_t));
+	if (output_damage->previous == NULL) {
+		pixman_region32_fini(&output_damage->current);
+		free(output_damage);
+		return NULL;
+	}
+	for (size_t i = 0; i < output_damage->previous_len; ++i) {
 		pixman_region32_init(&output_damage->previous[i]);
 	}
 
@@ -94,12 +105,43 @@ void wlr_output_damage_destroy(struct wlr_output_damage *output_damage) {
 	wl_list_remove(&output_damage->output_needs_swap.link);
 	wl_list_remove(&output_damage->output_frame.link);
 	pixman_region32_fini(&output_damage->current);
-	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_LEN; ++i) {
+	for (size_t i = 0; i < output_damage->previous_len; ++i) {
 		pixman_region32_fini(&output_damage->previous[i]);
 	}
+	free(output_damage->previous);
 	free(output_damage);
 }
 
+/**
+ * Grows the damage history to `len` entries. Damage of the frames before the
+ * history started is unknown, so new entries are set to the whole output.
+ */
+static void output_damage_grow_history(struct wlr_output_damage *output_damage,
+		size_t len) {
+	pixman_region32_t *previous = calloc(len, sizeof(pixman_region32_t));
+	if (previous == NULL) {
+		return;
+	}
+
+	// Copy the entries from the most recent one
+	size_t old_len = output_damage->previous_len;
+	for (size_t i = 0; i < old_len; ++i) {
+		size_t j = (output_damage->previous_idx + i) % old_len;
+		previous[i] = output_damage->previous[j];
+	}
+
+	int width, height;
+	wlr_output_transformed_resolution(output_damage->output, &width, &height);
+	for (size_t i = old_len; i < len; ++i) {
+		pixman_region32_init_rect(&previous[i], 0, 0, width, height);
+	}
+
+	free(output_damage->previous);
+	output_damage->previous = previous;
+	output_damage->previous_len = len;
+	output_damage->previous_idx = 0;
+}
+
 bool wlr_output_damage_make_current(struct wlr_output_damage *output_damage,
 		bool *needs_swap, pixman_region32_t *damage) {
 	struct wlr_output *output = output_damage->output;
@@ -109,8 +151,16 @@ bool wlr_output_damage_make_current(struct wlr_output_damage *output_damage,
 		return false;
 	}
 
+	if (buffer_age > 1 && (size_t)buffer_age - 1 > output_damage->previous_len &&
+			buffer_age - 1 <= WLR_OUTPUT_DAMAGE_PREVIOUS_MAX_LEN) {
+		// The output has a deeper swapchain than expected. This buffer is
+		// repainted fully, but damage tracking will work next time.
+		output_damage_grow_history(output_damage, buffer_age - 1);
+	}
+
 	// Check if we can use damage tracking
-	if (buffer_age <= 0 || buffer_age - 1 > WLR_OUTPUT_DAMAGE_PREVIOUS_LEN) {
+	if (buffer_age <= 0 ||
+			(size_t)buffer_age - 1 > output_damage->previous_len) {
 		int width, height;
 		wlr_output_transformed_resolution(output, &width, &height);
 
@@ -119,12 +169,19 @@ bool wlr_output_damage_make_current(struct wlr_output_damage *output_damage,
 	} else {
 		pixman_region32_copy(damage, &output_damage->current);
 
-		// Accumulate damage from old buffers
-		size_t idx = output_damage->previous_idx;
-		for (int i = 0; i < buffer_age - 1; ++i) {
-			int j = (idx + i) % WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
+		// Add damage from old buffers, already accumulated
+		if (buffer_age > 1) {
+			size_t j = (output_damage->previous_idx + buffer_age - 2) %
+				output_damage->previous_len;
 			pixman_region32_union(damage, damage, &output_damage->previous[j]);
 		}
+
+		// Fragmented damage makes rendering loop over many rectangles for
+		// each surface, repaint a bit more instead
+		if (output_damage->max_rects > 0) {
+			wlr_region_simplify(damage, damage, output_damage->rect_cost,
+				output_damage->max_rects);
+		}
 	}
 
 	*needs_swap = output->needs_swap || pixman_region32_not_empty(damage);
@@ -137,12 +194,22 @@ bool wlr_output_damage_swap_buffers(struct wlr_output_damage *output_damage,
 		return false;
 	}
 
-	// same as decrementing, but works on unsigned integers
-	output_damage->previous_idx += WLR_OUTPUT_DAMAGE_PREVIOUS_LEN - 1;
-	output_damage->previous_idx %= WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
+	size_t len = output_damage->previous_len;
 
-	pixman_region32_copy(&output_damage->previous[output_damage->previous_idx],
-		&output_damage->current);
+	// same as decrementing, but works on unsigned integers
+	output_damage->previous_idx += len - 1;
+	output_damage->previous_idx %= len;
+
+	// The oldest entry is dropped and becomes the most recent one, the others
+	// now cover one more frame
+	for (size_t i = 0; i < len; ++i) {
+		pixman_region32_t *previous = &output_damage->previous[i];
+		if (i == output_damage->previous_idx) {
+			pixman_region32_copy(previous, &output_damage->current);
+		} else {
+			pixman_region32_union(previous, previous, &output_damage->current);
+		}
+	}
 	pixman_region32_clear(&output_damage->current);
 
 	return true;
@@ -0,0 +1,370 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <wayland-server.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/util/log.h>
+#include "util/signal.h"
+
+/**
+ * Marks the layout geometry of the node as outdated, and its ancestors as
+ * having a descendant to update.
+ */
+static void scene_node_mark_dirty(struct wlr_scene_node *node) {
+	node->dirty = true;
+	// Ancestors of a node with child_dirty set already have it set
+	for (struct wlr_scene_node *parent = node->parent;
+			parent != NULL && !parent->child_dirty; parent = parent->parent) {
+		parent->child_dirty = true;
+	}
+}
+
+static void scene_node_init(struct wlr_scene_node *node,
+		struct wlr_scene_node *parent) {
+	node->parent = parent;
+	node->enabled = true;
+	wl_list_init(&node->children);
+	wl_list_init(&node->link);
+	wl_list_init(&node->surface_commit.link);
+	wl_list_init(&node->surface_new_subsurface.link);
+	wl_list_init(&node->surface_destroy.link);
+	wl_list_init(&node->subsurface_destroy.link);
+	wl_signal_init(&node->events.destroy);
+
+	if (parent != NULL) {
+		wl_list_insert(parent->children.prev, &node->link);
+	}
+	scene_node_mark_dirty(node);
+}
+
+struct wlr_scene_node *wlr_scene_node_create(struct wlr_scene_node *parent) {
+	struct wlr_scene_node *node = calloc(1, sizeof(struct wlr_scene_node));
+	if (node == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return NULL;
+	}
+	scene_node_init(node, parent);
+	return node;
+}
+
+void wlr_scene_node_destroy(struct wlr_scene_node *node) {
+	if (node == NULL) {
+		return;
+	}
+
+	wlr_signal_emit_safe(&node->events.destroy, node);
+
+	struct wlr_scene_node *child, *tmp;
+	wl_list_for_each_safe(child, tmp, &node->children, link) {
+		wlr_scene_node_destroy(child);
+	}
+
+	if (node->parent != NULL && node->enabled) {
+		// The parent subtree bounds need to be recomputed
+		scene_node_mark_dirty(node->parent);
+	}
+	wl_list_remove(&node->link);
+	wl_list_remove(&node->surface_commit.link);
+	wl_list_remove(&node->surface_new_subsurface.link);
+	wl_list_remove(&node->surface_destroy.link);
+	wl_list_remove(&node->subsurface_destroy.link);
+	free(node);
+}
+
+static struct wlr_scene_node *subsurface_node_create(
+	struct wlr_scene_node *parent, struct wlr_subsurface *subsurface);
+
+static void scene_node_handle_surface_new_subsurface(
+		struct wl_listener *listener, void *data) {
+	struct wlr_scene_node *node =
+		wl_container_of(listener, node, surface_new_subsurface);
+	struct wlr_subsurface *subsurface = data;
+	subsurface_node_create(node, subsurface);
+}
+
+static void scene_node_handle_surface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_scene_node *node =
+		wl_container_of(listener, node, surface_destroy);
+	// Keep the node, it belongs to the compositor
+	wl_list_remove(&node->surface_commit.link);
+	wl_list_init(&node->surface_commit.link);
+	wl_list_remove(&node->surface_new_subsurface.link);
+	wl_list_init(&node->surface_new_subsurface.link);
+	wl_list_remove(&node->surface_destroy.link);
+	wl_list_init(&node->surface_destroy.link);
+	node->surface = NULL;
+}
+
+static void scene_node_handle_subsurface_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_scene_node *node =
+		wl_container_of(listener, node, subsurface_destroy);
+	wlr_scene_node_destroy(node);
+}
+
+/**
+ * Finds the node created for a subsurface below `parent`. Subsurface nodes
+ * listen to the subsurface destruction, which only has a few listeners.
+ */
+static struct wlr_scene_node *subsurface_find_node(
+		struct wlr_subsurface *subsurface, struct wlr_scene_node *parent) {
+	struct wl_listener *listener;
+	wl_list_for_each(listener, &subsurface->events.destroy.listener_list,
+			link) {
+		if (listener->notify != scene_node_handle_subsurface_destroy) {
+			continue;
+		}
+		struct wlr_scene_node *node =
+			wl_container_of(listener, node, subsurface_destroy);
+		if (node->parent == parent) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+static void scene_node_handle_surface_commit(struct wl_listener *listener,
+		void *data) {
+	struct wlr_scene_node *node =
+		wl_container_of(listener, node, surface_commit);
+	struct wlr_surface_state *state = node->surface->current;
+
+	if (node->subsurface != NULL) {
+		wlr_scene_node_set_position(node, state->subsurface_position.x,
+			state->subsurface_position.y);
+	}
+	wlr_scene_node_set_size(node, state->width, state->height);
+
+	// Subsurfaces may have been restacked. Their nodes stay below the other
+	// children.
+	struct wl_list *prev = &node->children;
+	struct wlr_subsurface *subsurface;
+	wl_list_for_each(subsurface, &node->surface->subsurface_list,
+			parent_link) {
+		struct wlr_scene_node *child = subsurface_find_node(subsurface, node);
+		if (child == NULL) {
+			continue;
+		}
+		if (child->link.prev != prev) {
+			wl_list_remove(&child->link);
+			wl_list_insert(prev, &child->link);
+		}
+		prev = &child->link;
+	}
+}
+
+static bool scene_node_init_surface(struct wlr_scene_node *node,
+		struct wlr_surface *surface) {
+	node->surface = surface;
+	node->width = surface->current->width;
+	node->height = surface->current->height;
+
+	// Commits are handled before the compositor's own handlers, so that the
+	// layout is up-to-date in these
+	node->surface_commit.notify = scene_node_handle_surface_commit;
+	wl_list_insert(&surface->events.commit.listener_list,
+		&node->surface_commit.link);
+	node->surface_new_subsurface.notify =
+		scene_node_handle_surface_new_subsurface;
+	wl_signal_add(&surface->events.new_subsurface,
+		&node->surface_new_subsurface);
+	node->surface_destroy.notify = scene_node_handle_surface_destroy;
+	wl_signal_add(&surface->events.destroy, &node->surface_destroy);
+
+	struct wlr_subsurface *subsurface;
+	wl_list_for_each(subsurface, &surface->subsurface_list, parent_link) {
+		if (subsurface_node_create(node, subsurface) == NULL) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static struct wlr_scene_node *subsurface_node_create(
+		struct wlr_scene_node *parent, struct wlr_subsurface *subsurface) {
+	struct wlr_scene_node *node = wlr_scene_node_create(parent);
+	if (node == NULL) {
+		return NULL;
+	}
+	node->subsurface = subsurface;
+	node->x = subsurface->surface->current->subsurface_position.x;
+	node->y = subsurface->surface->current->subsurface_position.y;
+
+	node->subsurface_destroy.notify = scene_node_handle_subsurface_destroy;
+	wl_signal_add(&subsurface->events.destroy, &node->subsurface_destroy);
+
+	if (!scene_node_init_surface(node, subsurface->surface)) {
+		wlr_scene_node_destroy(node);
+		return NULL;
+	}
+	return node;
+}
+
+struct wlr_scene_node *wlr_scene_surface_create(struct wlr_scene_node *parent,
+		struct wlr_surface *surface) {
+	struct wlr_scene_node *node = wlr_scene_node_create(parent);
+	if (node == NULL) {
+		return NULL;
+	}
+	if (!scene_node_init_surface(node, surface)) {
+		wlr_scene_node_destroy(node);
+		return NULL;
+	}
+	return node;
+}
+
+void wlr_scene_node_set_enabled(struct wlr_scene_node *node, bool enabled) {
+	if (node->enabled == enabled) {
+		return;
+	}
+	node->enabled = enabled;
+	// Disabled nodes aren't kept up-to-date
+	scene_node_mark_dirty(node);
+}
+
+void wlr_scene_node_set_position(struct wlr_scene_node *node, double x,
+		double y) {
+	if (node->x == x && node->y == y) {
+		return;
+	}
+	node->x = x;
+	node->y = y;
+	scene_node_mark_dirty(node);
+}
+
+void wlr_scene_node_set_size(struct wlr_scene_node *node, int width,
+		int height) {
+	if (node->width == width && node->height == height) {
+		return;
+	}
+	node->width = width;
+	node->height = height;
+	scene_node_mark_dirty(node);
+}
+
+void wlr_scene_node_set_rotation(struct wlr_scene_node *node, float rotation) {
+	if (node->rotation == rotation) {
+		return;
+	}
+	node->rotation = rotation;
+	scene_node_mark_dirty(node);
+}
+
+static void box_union(struct wlr_box *dest, const struct wlr_box *box) {
+	if (wlr_box_empty(box)) {
+		return;
+	}
+	if (wlr_box_empty(dest)) {
+		*dest = *box;
+		return;
+	}
+	int x1 = fmin(dest->x, box->x);
+	int y1 = fmin(dest->y, box->y);
+	int x2 = fmax(dest->x + dest->width, box->x + box->width);
+	int y2 = fmax(dest->y + dest->height, box->y + box->height);
+	dest->x = x1;
+	dest->y = y1;
+	dest->width = x2 - x1;
+	dest->height = y2 - y1;
+}
+
+static void scene_node_update_layout(struct wlr_scene_node *node) {
+	struct wlr_scene_node *parent = node->parent;
+	double x = node->x, y = node->y;
+	float rotation = node->rotation;
+	if (parent != NULL) {
+		float parent_rotation = parent->layout.rotation;
+		if (parent_rotation != 0) {
+			// Rotate the node center around the parent center
+			double ox = x - (double)parent->width/2 + (double)node->width/2;
+			double oy = y - (double)parent->height/2 + (double)node->height/2;
+			double c = cos(-parent_rotation), s = sin(-parent_rotation);
+			x = c*ox - s*oy + (double)parent->width/2 - (double)node->width/2;
+			y = c*oy + s*ox + (double)parent->height/2 - (double)node->height/2;
+		}
+		x += parent->layout.x;
+		y += parent->layout.y;
+		rotation += parent_rotation;
+	}
+	node->layout.x = x;
+	node->layout.y = y;
+	node->layout.rotation = rotation;
+
+	// Bounds of the rotated node, rounded outwards from the exact position so
+	// that they can be used for damage tracking
+	double hw = (double)node->width/2, hh = (double)node->height/2;
+	if (rotation != 0) {
+		double c = fabs(cos(rotation)), s = fabs(sin(rotation));
+		double rhw = c*hw + s*hh;
+		hh = s*hw + c*hh;
+		hw = rhw;
+	}
+	double cx = x + (double)node->width/2, cy = y + (double)node->height/2;
+	int x1 = floor(cx - hw), y1 = floor(cy - hh);
+	int x2 = ceil(cx + hw), y2 = ceil(cy + hh);
+	node->layout.bounds.x = x1;
+	node->layout.bounds.y = y1;
+	node->layout.bounds.width = x2 - x1;
+	node->layout.bounds.height = y2 - y1;
+}
+
+static void scene_node_update(struct wlr_scene_node *node,
+		bool parent_changed) {
+	bool changed = node->dirty || parent_changed;
+	if (!changed && !node->child_dirty) {
+		// Nothing changed in this subtree
+		return;
+	}
+	if (changed) {
+		scene_node_update_layout(node);
+	}
+
+	node->dirty = false;
+	node->child_dirty = false;
+
+	struct wlr_box subtree_bounds = node->layout.bounds;
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &node->children, link) {
+		if (!child->enabled) {
+			continue;
+		}
+		scene_node_update(child, changed);
+		box_union(&subtree_bounds, &child->layout.subtree_bounds);
+	}
+	node->layout.subtree_bounds = subtree_bounds;
+}
+
+void wlr_scene_node_update(struct wlr_scene_node *node) {
+	assert(node->parent == NULL);
+	if (!node->enabled) {
+		return;
+	}
+	scene_node_update(node, false);
+}
+
+void wlr_scene_node_for_each_in_box(struct wlr_scene_node *node,
+		const struct wlr_box *box, wlr_scene_node_iterator_func_t iterator,
+		void *data) {
+	if (!node->enabled) {
+		return;
+	}
+
+	struct wlr_box intersection;
+	if (box != NULL && !wlr_box_intersection(&node->layout.subtree_bounds,
+			box, &intersection)) {
+		return;
+	}
+
+	if (box == NULL ||
+			wlr_box_intersection(&node->layout.bounds, box, &intersection)) {
+		iterator(node, data);
+	}
+
+	struct wlr_scene_node *child;
+	wl_list_for_each(child, &node->children, link) {
+		wlr_scene_node_for_each_in_box(child, box, iterator, data);
+	}
+}
@@ -0,0 +1,555 @@
+#define _POSIX_C_SOURCE 199309L
+#include <assert.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server.h>
+#include <wlr/backend.h>
+#include <wlr/render.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_screencast.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
+#include "screencast-protocol.h"
+
+/**
+ * Above this number of damaged rectangles, the damage extents are copied
+ * instead.
+ */
+#define SCREENCAST_MAX_COPY_RECTS 32
+
+// Delay between two polls of pending readbacks, in milliseconds
+#define SCREENCAST_POLL_DELAY 1
+
+struct screencast_readback {
+	struct wlr_readback *readback;
+	int32_t x, y; // destination in the buffer
+};
+
+static void resource_destroy(struct wl_client *client,
+		struct wl_resource *resource) {
+	wl_resource_destroy(resource);
+}
+
+static void screencast_readbacks_destroy(struct wlr_screencast *screencast) {
+	struct screencast_readback *readback;
+	wl_array_for_each(readback, &screencast->readbacks) {
+		wlr_readback_destroy(readback->readback);
+	}
+	screencast->readbacks.size = 0;
+}
+
+/**
+ * Aborts the frame being captured, if any.
+ */
+static void screencast_capture_cancel(struct wlr_screencast *screencast) {
+	if (screencast->capture_buffer == NULL) {
+		return;
+	}
+	// Readbacks are destroyed with the renderer context current
+	wlr_output_make_current(screencast->output, NULL);
+	screencast_readbacks_destroy(screencast);
+	pixman_region32_clear(&screencast->capture_damage);
+	screencast->capture_buffer = NULL;
+}
+
+static void screencast_buffer_destroy(struct wlr_screencast_buffer *buffer) {
+	if (buffer->screencast->capture_buffer == buffer) {
+		screencast_capture_cancel(buffer->screencast);
+	}
+	wl_list_remove(&buffer->resource_destroy.link);
+	wl_list_remove(&buffer->link);
+	pixman_region32_fini(&buffer->damage);
+	free(buffer);
+}
+
+static void screencast_buffer_handle_resource_destroy(
+		struct wl_listener *listener, void *data) {
+	struct wlr_screencast_buffer *buffer =
+		wl_container_of(listener, buffer, resource_destroy);
+	screencast_buffer_destroy(buffer);
+}
+
+static struct wlr_screencast_buffer *screencast_buffer_from_resource(
+		struct wlr_screencast *screencast, struct wl_resource *resource) {
+	struct wlr_screencast_buffer *buffer;
+	wl_list_for_each(buffer, &screencast->buffers, link) {
+		if (buffer->resource == resource) {
+			return buffer;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Returns the rectangles to copy to bring the buffer up-to-date, in buffer
+ * coordinates.
+ */
+static pixman_box32_t *screencast_buffer_stale_rects(
+		struct wlr_screencast_buffer *buffer, int *nrects) {
+	struct wlr_output *output = buffer->screencast->output;
+	pixman_region32_intersect_rect(&buffer->damage, &buffer->damage, 0, 0,
+		output->width, output->height);
+
+	pixman_box32_t *rects = pixman_region32_rectangles(&buffer->damage,
+		nrects);
+	if (*nrects > SCREENCAST_MAX_COPY_RECTS) {
+		*nrects = 1;
+		return pixman_region32_extents(&buffer->damage);
+	}
+	return rects;
+}
+
+/**
+ * Copies the stale pixels of the buffer from the output's framebuffer, waiting
+ * for rendering to complete. The output must be current.
+ */
+static bool screencast_buffer_copy(struct wlr_screencast_buffer *buffer) {
+	struct wlr_output *output = buffer->screencast->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer->resource);
+
+	enum wl_shm_format format = wl_shm_buffer_get_format(shm_buffer);
+	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+
+	int nrects;
+	pixman_box32_t *rects = screencast_buffer_stale_rects(buffer, &nrects);
+
+	bool ok = true;
+	wl_shm_buffer_begin_access(shm_buffer);
+	void *data = wl_shm_buffer_get_data(shm_buffer);
+	for (int i = 0; i < nrects && ok; ++i) {
+		pixman_box32_t *rect = &rects[i];
+		// The renderer reads pixels upside down
+		ok = wlr_renderer_read_pixels(renderer, format, stride,
+			rect->x2 - rect->x1, rect->y2 - rect->y1,
+			rect->x1, output->height - rect->y2, rect->x1, rect->y1, data);
+	}
+	wl_shm_buffer_end_access(shm_buffer);
+
+	if (ok) {
+		pixman_region32_clear(&buffer->damage);
+	}
+	return ok;
+}
+
+static void screencast_detach_output(struct wlr_screencast *screencast) {
+	if (screencast->output == NULL) {
+		return;
+	}
+	screencast_capture_cancel(screencast);
+	if (screencast->readback_timer != NULL) {
+		wl_event_source_remove(screencast->readback_timer);
+		screencast->readback_timer = NULL;
+	}
+	wlr_output_lock_direct_scanout(screencast->output, false);
+	wl_list_remove(&screencast->output_swap_buffers.link);
+	wl_list_remove(&screencast->output_destroy.link);
+	screencast->output = NULL;
+}
+
+static void screencast_fail(struct wlr_screencast *screencast) {
+	if (screencast->output == NULL) {
+		return;
+	}
+	screencast_detach_output(screencast);
+	screencast_send_failed(screencast->resource);
+}
+
+static void screencast_export_frame(struct wlr_screencast *screencast,
+		struct wlr_screencast_buffer *buffer) {
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(
+		&screencast->capture_damage, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		screencast_send_damage(screencast->resource, rects[i].x1, rects[i].y1,
+			rects[i].x2 - rects[i].x1, rects[i].y2 - rects[i].y1);
+	}
+	pixman_region32_clear(&screencast->capture_damage);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	screencast_send_frame(screencast->resource, buffer->resource,
+		(uint32_t)now.tv_sec, (uint32_t)now.tv_nsec);
+}
+
+/**
+ * Copies the pixels of the finished readbacks into the capture buffer and
+ * exports it.
+ */
+static void screencast_capture_finish(struct wlr_screencast *screencast) {
+	struct wlr_screencast_buffer *buffer = screencast->capture_buffer;
+	if (!wlr_output_make_current(screencast->output, NULL)) {
+		wlr_log(L_ERROR, "Cannot make output current");
+		screencast_fail(screencast);
+		return;
+	}
+
+	struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer->resource);
+	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+
+	bool ok = true;
+	wl_shm_buffer_begin_access(shm_buffer);
+	void *data = wl_shm_buffer_get_data(shm_buffer);
+	struct screencast_readback *readback;
+	wl_array_for_each(readback, &screencast->readbacks) {
+		if (!wlr_readback_finish(readback->readback, stride,
+				readback->x, readback->y, data)) {
+			ok = false;
+			break;
+		}
+	}
+	wl_shm_buffer_end_access(shm_buffer);
+	screencast_readbacks_destroy(screencast);
+	screencast->capture_buffer = NULL;
+
+	if (!ok) {
+		wlr_log(L_ERROR, "Failed to capture screencast frame");
+		screencast_fail(screencast);
+		return;
+	}
+
+	screencast_export_frame(screencast, buffer);
+}
+
+static int screencast_handle_readback_timer(void *data) {
+	struct wlr_screencast *screencast = data;
+	struct screencast_readback *readback;
+	wl_array_for_each(readback, &screencast->readbacks) {
+		if (!wlr_readback_ready(readback->readback)) {
+			wl_event_source_timer_update(screencast->readback_timer,
+				SCREENCAST_POLL_DELAY);
+			return 0;
+		}
+	}
+	screencast_capture_finish(screencast);
+	return 0;
+}
+
+/**
+ * Starts reading the stale pixels of the buffer back from the output's
+ * framebuffer without waiting for rendering to complete. The output must be
+ * current. Returns false if the pixels can't be read asynchronously.
+ */
+static bool screencast_capture_start(struct wlr_screencast *screencast,
+		struct wlr_screencast_buffer *buffer) {
+	struct wlr_output *output = screencast->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer->resource);
+	enum wl_shm_format format = wl_shm_buffer_get_format(shm_buffer);
+
+	if (screencast->readback_timer == NULL) {
+		struct wl_display *display = wl_client_get_display(
+			wl_resource_get_client(screencast->resource));
+		screencast->readback_timer = wl_event_loop_add_timer(
+			wl_display_get_event_loop(display),
+			screencast_handle_readback_timer, screencast);
+		if (screencast->readback_timer == NULL) {
+			wlr_log(L_ERROR, "Failed to create readback timer");
+			return false;
+		}
+	}
+
+	int nrects;
+	pixman_box32_t *rects = screencast_buffer_stale_rects(buffer, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		pixman_box32_t *rect = &rects[i];
+		// The renderer reads pixels upside down
+		struct wlr_readback *readback = wlr_renderer_read_pixels_async(
+			renderer, format, rect->x2 - rect->x1, rect->y2 - rect->y1,
+			rect->x1, output->height - rect->y2);
+		if (readback == NULL) {
+			screencast_readbacks_destroy(screencast);
+			return false;
+		}
+		struct screencast_readback *r =
+			wl_array_add(&screencast->readbacks, sizeof(*r));
+		if (r == NULL) {
+			wlr_readback_destroy(readback);
+			screencast_readbacks_destroy(screencast);
+			return false;
+		}
+		r->readback = readback;
+		r->x = rect->x1;
+		r->y = rect->y1;
+	}
+	pixman_region32_clear(&buffer->damage);
+
+	screencast->capture_buffer = buffer;
+	wl_event_source_timer_update(screencast->readback_timer,
+		SCREENCAST_POLL_DELAY);
+	return true;
+}
+
+static void screencast_handle_output_swap_buffers(struct wl_listener *listener,
+		void *data) {
+	struct wlr_screencast *screencast =
+		wl_container_of(listener, screencast, output_swap_buffers);
+	struct wlr_output *output = screencast->output;
+	pixman_region32_t *damage = data;
+
+	int width, height;
+	wlr_output_transformed_resolution(output, &width, &height);
+
+	pixman_region32_t frame_damage;
+	pixman_region32_init_rect(&frame_damage, 0, 0, width, height);
+	if (damage != NULL) {
+		pixman_region32_intersect(&frame_damage, &frame_damage, damage);
+	}
+	if (!pixman_region32_not_empty(&frame_damage)) {
+		pixman_region32_fini(&frame_damage);
+		return;
+	}
+
+	// Convert the damage to buffer coordinates
+	wlr_region_transform(&frame_damage, &frame_damage,
+		wlr_output_transform_invert(output->transform), width, height);
+
+	pixman_region32_union(&screencast->damage, &screencast->damage,
+		&frame_damage);
+	struct wlr_screencast_buffer *buffer, *target = NULL;
+	wl_list_for_each(buffer, &screencast->buffers, link) {
+		pixman_region32_union(&buffer->damage, &buffer->damage, &frame_damage);
+		if (target == NULL && buffer->attached) {
+			target = buffer;
+		}
+	}
+	pixman_region32_fini(&frame_damage);
+
+	if (target == NULL || screencast->capture_buffer != NULL) {
+		// No buffer available or previous frame still being read back, skip
+		// this frame
+		return;
+	}
+
+	struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(target->resource);
+	if (wl_shm_buffer_get_width(shm_buffer) < output->width ||
+			wl_shm_buffer_get_height(shm_buffer) < output->height) {
+		wlr_log(L_ERROR, "Screencast buffer is smaller than the output");
+		screencast_fail(screencast);
+		return;
+	}
+
+	target->attached = false;
+	pixman_region32_copy(&screencast->capture_damage, &screencast->damage);
+	pixman_region32_clear(&screencast->damage);
+
+	// Fall back to a synchronous copy if the renderer can't read pixels
+	// asynchronously
+	if (screencast_capture_start(screencast, target)) {
+		return;
+	}
+	if (!screencast_buffer_copy(target)) {
+		wlr_log(L_ERROR, "Failed to capture screencast frame");
+		screencast_fail(screencast);
+		return;
+	}
+	screencast_export_frame(screencast, target);
+}
+
+static void screencast_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_screencast *screencast =
+		wl_container_of(listener, screencast, output_destroy);
+	screencast_fail(screencast);
+}
+
+static void screencast_attach_buffer(struct wl_client *client,
+		struct wl_resource *screencast_resource,
+		struct wl_resource *buffer_resource) {
+	struct wlr_screencast *screencast =
+		wl_resource_get_user_data(screencast_resource);
+	if (screencast == NULL || screencast->output == NULL) {
+		return;
+	}
+	struct wlr_output *output = screencast->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+
+	struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer_resource);
+	if (shm_buffer == NULL) {
+		wl_resource_post_error(screencast_resource,
+			SCREENCAST_ERROR_INVALID_BUFFER,
+			"Invalid buffer: not a shared memory buffer");
+		return;
+	}
+	if (wl_shm_buffer_get_width(shm_buffer) < output->width ||
+			wl_shm_buffer_get_height(shm_buffer) < output->height) {
+		wl_resource_post_error(screencast_resource,
+			SCREENCAST_ERROR_INVALID_BUFFER, "Invalid buffer: too small");
+		return;
+	}
+	if (!wlr_renderer_format_supported(renderer,
+			wl_shm_buffer_get_format(shm_buffer))) {
+		wl_resource_post_error(screencast_resource,
+			SCREENCAST_ERROR_INVALID_BUFFER,
+			"Invalid buffer: unsupported format");
+		return;
+	}
+
+	struct wlr_screencast_buffer *buffer =
+		screencast_buffer_from_resource(screencast, buffer_resource);
+	if (buffer != NULL) {
+		if (buffer->attached) {
+			wl_resource_post_error(screencast_resource,
+				SCREENCAST_ERROR_INVALID_BUFFER,
+				"Invalid buffer: already attached");
+			return;
+		}
+		// Keep the queue ordered
+		wl_list_remove(&buffer->link);
+	} else {
+		buffer = calloc(1, sizeof(struct wlr_screencast_buffer));
+		if (buffer == NULL) {
+			wl_client_post_no_memory(client);
+			return;
+		}
+		buffer->resource = buffer_resource;
+		buffer->screencast = screencast;
+		pixman_region32_init_rect(&buffer->damage, 0, 0,
+			output->width, output->height);
+		buffer->resource_destroy.notify =
+			screencast_buffer_handle_resource_destroy;
+		wl_resource_add_destroy_listener(buffer_resource,
+			&buffer->resource_destroy);
+	}
+	buffer->attached = true;
+	wl_list_insert(screencast->buffers.prev, &buffer->link);
+}
+
+static const struct screencast_interface screencast_impl = {
+	.destroy = resource_destroy,
+	.attach_buffer = screencast_attach_buffer,
+};
+
+static void screencast_destroy(struct wlr_screencast *screencast) {
+	if (screencast == NULL) {
+		return;
+	}
+	screencast_detach_output(screencast);
+	struct wlr_screencast_buffer *buffer, *tmp;
+	wl_list_for_each_safe(buffer, tmp, &screencast->buffers, link) {
+		screencast_buffer_destroy(buffer);
+	}
+	pixman_region32_fini(&screencast->damage);
+	pixman_region32_fini(&screencast->capture_damage);
+	wl_array_release(&screencast->readbacks);
+	wl_resource_set_user_data(screencast->resource, NULL);
+	wl_list_remove(&screencast->link);
+	free(screencast);
+}
+
+static void screencast_destroy_resource(struct wl_resource *resource) {
+	struct wlr_screencast *screencast = wl_resource_get_user_data(resource);
+	screencast_destroy(screencast);
+}
+
+static void screencast_manager_capture_output(struct wl_client *client,
+		struct wl_resource *manager_resource, uint32_t id,
+		struct wl_resource *output_resource) {
+	struct wlr_screencast_manager *manager =
+		wl_resource_get_user_data(manager_resource);
+	struct wlr_output *output = wl_resource_get_user_data(output_resource);
+
+	struct wlr_screencast *screencast =
+		calloc(1, sizeof(struct wlr_screencast));
+	if (screencast == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	int version = wl_resource_get_version(manager_resource);
+	screencast->resource = wl_resource_create(client, &screencast_interface,
+		version, id);
+	if (screencast->resource == NULL) {
+		free(screencast);
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wlr_log(L_DEBUG, "new screencast %p (res %p)", screencast,
+		screencast->resource);
+	wl_resource_set_implementation(screencast->resource, &screencast_impl,
+		screencast, screencast_destroy_resource);
+
+	wl_list_init(&screencast->buffers);
+	pixman_region32_init(&screencast->damage);
+	pixman_region32_init(&screencast->capture_damage);
+	wl_array_init(&screencast->readbacks);
+	wl_list_insert(&manager->screencasts, &screencast->link);
+
+	if (wlr_backend_get_renderer(output->backend) == NULL) {
+		wlr_log(L_ERROR, "Backend doesn't have a renderer");
+		screencast_send_failed(screencast->resource);
+		return;
+	}
+
+	screencast->output = output;
+	screencast->output_swap_buffers.notify =
+		screencast_handle_output_swap_buffers;
+	wl_signal_add(&output->events.swap_buffers,
+		&screencast->output_swap_buffers);
+	screencast->output_destroy.notify = screencast_handle_output_destroy;
+	wl_signal_add(&output->events.destroy, &screencast->output_destroy);
+	// Frames are read back from the output buffer, which must hold them
+	wlr_output_lock_direct_scanout(output, true);
+}
+
+static const struct screencast_manager_interface screencast_manager_impl = {
+	.destroy = resource_destroy,
+	.capture_output = screencast_manager_capture_output,
+};
+
+static void screencast_manager_bind(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id) {
+	struct wlr_screencast_manager *manager = data;
+	assert(client && manager);
+
+	struct wl_resource *resource = wl_resource_create(client,
+		&screencast_manager_interface, version, id);
+	if (resource == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &screencast_manager_impl,
+		manager, NULL);
+}
+
+void wlr_screencast_manager_destroy(struct wlr_screencast_manager *manager) {
+	if (!manager) {
+		return;
+	}
+	wl_list_remove(&manager->display_destroy.link);
+	struct wlr_screencast *screencast, *tmp;
+	wl_list_for_each_safe(screencast, tmp, &manager->screencasts, link) {
+		screencast_destroy(screencast);
+	}
+	wl_global_destroy(manager->wl_global);
+	free(manager);
+}
+
+static void handle_display_destroy(struct wl_listener *listener, void *data) {
+	struct wlr_screencast_manager *manager =
+		wl_container_of(listener, manager, display_destroy);
+	wlr_screencast_manager_destroy(manager);
+}
+
+struct wlr_screencast_manager *wlr_screencast_manager_create(
+		struct wl_display *display) {
+	struct wlr_screencast_manager *manager =
+		calloc(1, sizeof(struct wlr_screencast_manager));
+	if (!manager) {
+		return NULL;
+	}
+	struct wl_global *wl_global = wl_global_create(display,
+		&screencast_manager_interface, 1, manager, screencast_manager_bind);
+	if (!wl_global) {
+		free(manager);
+		return NULL;
+	}
+	manager->wl_global = wl_global;
+
+	wl_list_init(&manager->screencasts);
+
+	manager->display_destroy.notify = handle_display_destroy;
+	wl_display_add_destroy_listener(display, &manager->display_destroy);
+
+	return manager;
+}
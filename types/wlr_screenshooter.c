@@ -9,12 +9,104 @@
 #include <wlr/util/log.h>
 #include "screenshooter-protocol.h"
 
+// Delay between two polls of a pending readback, in milliseconds
+#define SCREENSHOT_POLL_DELAY 1
+
 struct screenshot_state {
 	struct wl_shm_buffer *shm_buffer;
 	struct wlr_screenshot *screenshot;
+	struct wlr_output *output;
 	struct wl_listener frame_listener;
+	struct wl_listener output_destroy;
+	struct wl_listener screenshot_destroy;
+	struct wl_listener buffer_destroy;
+
+	struct wlr_readback *readback;
+	struct wl_event_source *readback_timer;
 };
 
+static void screenshot_state_destroy(struct screenshot_state *state) {
+	if (state->readback != NULL) {
+		wlr_output_make_current(state->output, NULL);
+		wlr_readback_destroy(state->readback);
+	}
+	if (state->readback_timer != NULL) {
+		wl_event_source_remove(state->readback_timer);
+	}
+	wlr_output_lock_direct_scanout(state->output, false);
+	wl_list_remove(&state->frame_listener.link);
+	wl_list_remove(&state->output_destroy.link);
+	wl_list_remove(&state->screenshot_destroy.link);
+	wl_list_remove(&state->buffer_destroy.link);
+	free(state);
+}
+
+static void screenshot_state_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct screenshot_state *state =
+		wl_container_of(listener, state, output_destroy);
+	screenshot_state_destroy(state);
+}
+
+static void screenshot_state_handle_screenshot_destroy(
+		struct wl_listener *listener, void *data) {
+	struct screenshot_state *state =
+		wl_container_of(listener, state, screenshot_destroy);
+	screenshot_state_destroy(state);
+}
+
+static void screenshot_state_handle_buffer_destroy(struct wl_listener *listener,
+		void *data) {
+	struct screenshot_state *state =
+		wl_container_of(listener, state, buffer_destroy);
+	screenshot_state_destroy(state);
+}
+
+static void screenshot_state_copy(struct screenshot_state *state) {
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(state->output->backend);
+	struct wl_shm_buffer *shm_buffer = state->shm_buffer;
+
+	enum wl_shm_format format = wl_shm_buffer_get_format(shm_buffer);
+	int32_t width = wl_shm_buffer_get_width(shm_buffer);
+	int32_t height = wl_shm_buffer_get_height(shm_buffer);
+	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
+	wl_shm_buffer_begin_access(shm_buffer);
+	void *data = wl_shm_buffer_get_data(shm_buffer);
+	bool ok;
+	if (state->readback != NULL) {
+		ok = wlr_readback_finish(state->readback, stride, 0, 0, data);
+	} else {
+		ok = wlr_renderer_read_pixels(renderer, format, stride, width, height,
+			0, 0, 0, 0, data);
+	}
+	wl_shm_buffer_end_access(shm_buffer);
+
+	if (!ok) {
+		wlr_log(L_ERROR, "Cannot read pixels");
+		return;
+	}
+
+	orbital_screenshot_send_done(state->screenshot->resource);
+}
+
+static int screenshot_state_handle_readback_timer(void *data) {
+	struct screenshot_state *state = data;
+	if (!wlr_readback_ready(state->readback)) {
+		wl_event_source_timer_update(state->readback_timer,
+			SCREENSHOT_POLL_DELAY);
+		return 0;
+	}
+
+	if (wlr_output_make_current(state->output, NULL)) {
+		screenshot_state_copy(state);
+	} else {
+		wlr_log(L_ERROR, "Cannot make output current");
+	}
+	screenshot_state_destroy(state);
+	return 0;
+}
+
 static void screenshot_destroy(struct wlr_screenshot *screenshot) {
 	wl_list_remove(&screenshot->link);
 	wl_resource_set_user_data(screenshot->resource, NULL);
@@ -33,30 +125,36 @@ static void handle_screenshot_resource_destroy(
 static void output_handle_frame(struct wl_listener *listener, void *_data) {
 	struct screenshot_state *state = wl_container_of(listener, state,
 		frame_listener);
-	struct wlr_output *output = state->screenshot->output;
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(state->output->backend);
 	struct wl_shm_buffer *shm_buffer = state->shm_buffer;
 
-	enum wl_shm_format format = wl_shm_buffer_get_format(shm_buffer);
-	int32_t width = wl_shm_buffer_get_width(shm_buffer);
-	int32_t height = wl_shm_buffer_get_height(shm_buffer);
-	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
-	wl_shm_buffer_begin_access(shm_buffer);
-	void *data = wl_shm_buffer_get_data(shm_buffer);
-	bool ok = wlr_renderer_read_pixels(renderer, format, stride, width, height,
-		0, 0, 0, 0, data);
-	wl_shm_buffer_end_access(shm_buffer);
+	wl_list_remove(&state->frame_listener.link);
+	wl_list_init(&state->frame_listener.link);
 
-	if (!ok) {
-		wlr_log(L_ERROR, "Cannot read pixels");
-		goto cleanup;
+	// Start copying the frame without stalling on the GPU, and poll until
+	// the pixels are available. Fall back to a synchronous read if the
+	// renderer doesn't support it.
+	state->readback = wlr_renderer_read_pixels_async(renderer,
+		wl_shm_buffer_get_format(shm_buffer),
+		wl_shm_buffer_get_width(shm_buffer),
+		wl_shm_buffer_get_height(shm_buffer), 0, 0);
+	if (state->readback != NULL) {
+		struct wl_display *display = wl_client_get_display(
+			wl_resource_get_client(state->screenshot->resource));
+		state->readback_timer =
+			wl_event_loop_add_timer(wl_display_get_event_loop(display),
+				screenshot_state_handle_readback_timer, state);
+		if (state->readback_timer != NULL) {
+			wl_event_source_timer_update(state->readback_timer,
+				SCREENSHOT_POLL_DELAY);
+			return;
+		}
+		wlr_log(L_ERROR, "Failed to create readback timer");
 	}
 
-	orbital_screenshot_send_done(state->screenshot->resource);
-
-cleanup:
-	wl_list_remove(&listener->link);
-	free(state);
+	screenshot_state_copy(state);
+	screenshot_state_destroy(state);
 }
 
 static void screenshooter_shoot(struct wl_client *client,
@@ -125,8 +223,20 @@ static void screenshooter_shoot(struct wl_client *client,
 	}
 	state->shm_buffer = shm_buffer;
 	state->screenshot = screenshot;
+	state->output = output;
 	state->frame_listener.notify = output_handle_frame;
 	wl_signal_add(&output->events.swap_buffers, &state->frame_listener);
+	state->output_destroy.notify = screenshot_state_handle_output_destroy;
+	wl_signal_add(&output->events.destroy, &state->output_destroy);
+	state->screenshot_destroy.notify =
+		screenshot_state_handle_screenshot_destroy;
+	wl_resource_add_destroy_listener(screenshot->resource,
+		&state->screenshot_destroy);
+	state->buffer_destroy.notify = screenshot_state_handle_buffer_destroy;
+	wl_resource_add_destroy_listener(buffer_resource, &state->buffer_destroy);
+
+	// The frame is read back from the output buffer, which must hold it
+	wlr_output_lock_direct_scanout(output, true);
 
 	// Schedule a buffer swap
 	output->needs_swap = true;
@@ -261,7 +261,7 @@ static void wlr_surface_move_state(struct wlr_surface *surface,
 	}
 	if ((next->invalid & WLR_SURFACE_INVALID_OPAQUE_REGION)) {
 		// TODO: process buffer
-		pixman_region32_clear(&next->opaque);
+		pixman_region32_copy(&state->opaque, &next->opaque);
 	}
 	if ((next->invalid & WLR_SURFACE_INVALID_INPUT_REGION)) {
 		// TODO: process buffer
@@ -313,6 +313,71 @@ static void wlr_surface_damage_subsurfaces(struct wlr_subsurface *subsurface) {
 	}
 }
 
+static void surface_buffer_handle_resource_destroy(
+		struct wl_listener *listener, void *data) {
+	struct wlr_surface_buffer *buffer =
+		wl_container_of(listener, buffer, resource_destroy);
+	wl_list_remove(&buffer->resource_destroy.link);
+	wl_list_init(&buffer->resource_destroy.link);
+	buffer->resource = NULL;
+}
+
+static struct wlr_surface_buffer *surface_buffer_create(
+		struct wl_resource *resource) {
+	struct wlr_surface_buffer *buffer =
+		calloc(1, sizeof(struct wlr_surface_buffer));
+	if (buffer == NULL) {
+		return NULL;
+	}
+	buffer->resource = resource;
+	buffer->n_refs = 1;
+	buffer->resource_destroy.notify = surface_buffer_handle_resource_destroy;
+	wl_resource_add_destroy_listener(resource, &buffer->resource_destroy);
+	return buffer;
+}
+
+struct wlr_surface_buffer *wlr_surface_buffer_ref(
+		struct wlr_surface_buffer *buffer) {
+	buffer->n_refs++;
+	return buffer;
+}
+
+void wlr_surface_buffer_unref(struct wlr_surface_buffer *buffer) {
+	if (buffer == NULL) {
+		return;
+	}
+	assert(buffer->n_refs > 0);
+	if (--buffer->n_refs > 0) {
+		return;
+	}
+
+	if (buffer->resource != NULL) {
+		wl_resource_post_event(buffer->resource, WL_BUFFER_RELEASE);
+	}
+	wl_list_remove(&buffer->resource_destroy.link);
+	free(buffer);
+}
+
+/**
+ * Makes `resource` the current buffer of the surface, without releasing it.
+ * The previous buffer is released once nothing uses it anymore.
+ */
+static void surface_set_buffer(struct wlr_surface *surface,
+		struct wl_resource *resource) {
+	if (surface->buffer != NULL && surface->buffer->resource == resource) {
+		return;
+	}
+
+	wlr_surface_buffer_unref(surface->buffer);
+	surface->buffer = NULL;
+	if (resource != NULL) {
+		surface->buffer = surface_buffer_create(resource);
+		if (surface->buffer == NULL) {
+			wl_resource_post_no_memory(surface->resource);
+		}
+	}
+}
+
 static void wlr_surface_apply_damage(struct wlr_surface *surface,
 		bool reupload_buffer) {
 	if (!surface->current->buffer) {
@@ -323,13 +388,20 @@ static void wlr_surface_apply_damage(struct wlr_surface *surface,
 		if (wlr_renderer_buffer_is_drm(surface->renderer,
 					surface->current->buffer)) {
 			wlr_texture_upload_drm(surface->texture, surface->current->buffer);
-			goto release;
+			// The texture and scanout use the buffer contents directly, so
+			// keep it until it is replaced and off-screen
+			surface_set_buffer(surface, surface->current->buffer);
+			wlr_surface_state_reset_buffer(surface->current);
+			return;
 		} else {
 			wlr_log(L_INFO, "Unknown buffer handle attached");
 			return;
 		}
 	}
 
+	// The previous buffer may have been kept
+	surface_set_buffer(surface, NULL);
+
 	uint32_t format = wl_shm_buffer_get_format(buffer);
 	if (reupload_buffer) {
 		wlr_texture_upload_shm(surface->texture, format, buffer);
@@ -340,23 +412,11 @@ static void wlr_surface_apply_damage(struct wlr_surface *surface,
 		pixman_region32_intersect_rect(&damage, &damage, 0, 0,
 			surface->current->buffer_width, surface->current->buffer_height);
 
-		int n;
-		pixman_box32_t *rects = pixman_region32_rectangles(&damage, &n);
-		for (int i = 0; i < n; ++i) {
-			pixman_box32_t rect = rects[i];
-			if (!wlr_texture_update_shm(surface->texture, format,
-					rect.x1, rect.y1,
-					rect.x2 - rect.x1,
-					rect.y2 - rect.y1,
-					buffer)) {
-				break;
-			}
-		}
-
+		wlr_texture_update_shm_region(surface->texture, format, &damage,
+			buffer);
 		pixman_region32_fini(&damage);
 	}
 
-release:
 	wlr_surface_state_release_buffer(surface->current);
 }
 
@@ -372,6 +432,7 @@ static void wlr_surface_commit_pending(struct wlr_surface *surface) {
 
 	if (null_buffer_commit) {
 		surface->texture->valid = false;
+		surface_set_buffer(surface, NULL);
 	}
 
 	bool reupload_buffer = oldw != surface->current->buffer_width ||
@@ -585,6 +646,7 @@ static void destroy_surface(struct wl_resource *resource) {
 		wlr_subsurface_destroy(surface->subsurface);
 	}
 
+	wlr_surface_buffer_unref(surface->buffer);
 	wlr_texture_destroy(surface->texture);
 	wlr_surface_state_destroy(surface->pending);
 	wlr_surface_state_destroy(surface->current);
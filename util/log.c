@@ -1,6 +1,12 @@
 #define _POSIX_C_SOURCE 199506L
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,7 +15,7 @@
 #include <wlr/util/log.h>
 
 static bool colored = true;
-static log_importance_t log_importance = L_ERROR;
+log_importance_t _wlr_log_importance = L_ERROR;
 
 static const char *verbosity_colors[] = {
 	[L_SILENT] = "",
@@ -18,13 +24,10 @@ static const char *verbosity_colors[] = {
 	[L_DEBUG ] = "\x1B[1;30m",
 };
 
-void wlr_log_stderr(log_importance_t verbosity, const char *fmt, va_list args) {
-	if (verbosity > log_importance) {
-		return;
-	}
+static void log_print(log_importance_t verbosity, time_t t, const char *fmt,
+		va_list args) {
 	// prefix the time to the log message
 	struct tm result;
-	time_t t = time(NULL);
 	struct tm *tm_info = localtime_r(&t, &result);
 	char buffer[26];
 
@@ -46,17 +49,195 @@ void wlr_log_stderr(log_importance_t verbosity, const char *fmt, va_list args) {
 	fprintf(stderr, "\n");
 }
 
+static void log_printf(log_importance_t verbosity, time_t t,
+		const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	log_print(verbosity, t, fmt, args);
+	va_end(args);
+}
+
+void wlr_log_stderr(log_importance_t verbosity, const char *fmt, va_list args) {
+	if (verbosity > _wlr_log_importance) {
+		return;
+	}
+	log_print(verbosity, time(NULL), fmt, args);
+}
+
 static log_callback_t log_callback = wlr_log_stderr;
 
 void wlr_log_init(log_importance_t verbosity, log_callback_t callback) {
 	if (verbosity < L_LAST) {
-		log_importance = verbosity;
+		_wlr_log_importance = verbosity;
 	}
 	if (callback) {
 		log_callback = callback;
 	}
 }
 
+// Must be a power of two
+#define LOG_ASYNC_RING_SIZE 256
+// Longer messages are truncated
+#define LOG_ASYNC_MESSAGE_SIZE 512
+
+struct log_async_slot {
+	// Equal to the position of the slot when it can be written, to the
+	// position plus one when it holds a message
+	atomic_size_t seq;
+	log_importance_t verbosity;
+	time_t time;
+	char message[LOG_ASYNC_MESSAGE_SIZE];
+};
+
+/**
+ * A bounded multi-producer, single-consumer queue. Producers never block: they
+ * claim a slot by advancing `enqueue_pos`, or drop the message if the ring is
+ * full. Each queued message posts `sem` once to wake the writer thread.
+ */
+static struct {
+	struct log_async_slot *ring;
+	atomic_size_t enqueue_pos;
+	size_t dequeue_pos; // only used by the writer thread
+	atomic_uint_fast64_t dropped;
+	atomic_bool stopping;
+	sem_t sem;
+	pthread_t thread;
+	bool running;
+} log_async;
+
+static void log_async_callback(log_importance_t verbosity, const char *fmt,
+		va_list args) {
+	if (verbosity > _wlr_log_importance) {
+		return;
+	}
+
+	struct log_async_slot *slot;
+	size_t pos = atomic_load_explicit(&log_async.enqueue_pos,
+		memory_order_relaxed);
+	while (true) {
+		slot = &log_async.ring[pos & (LOG_ASYNC_RING_SIZE - 1)];
+		size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&log_async.enqueue_pos,
+					&pos, pos + 1, memory_order_relaxed,
+					memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// The writer thread is behind, don't wait for it
+			atomic_fetch_add_explicit(&log_async.dropped, 1,
+				memory_order_relaxed);
+			return;
+		} else {
+			pos = atomic_load_explicit(&log_async.enqueue_pos,
+				memory_order_relaxed);
+		}
+	}
+
+	slot->verbosity = verbosity;
+	slot->time = time(NULL);
+	vsnprintf(slot->message, sizeof(slot->message), fmt, args);
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+	sem_post(&log_async.sem);
+}
+
+static void *log_async_run(void *data) {
+	while (true) {
+		if (sem_wait(&log_async.sem) != 0) {
+			continue; // EINTR
+		}
+
+		size_t pos = log_async.dequeue_pos;
+		if (atomic_load(&log_async.stopping) &&
+				pos == atomic_load(&log_async.enqueue_pos)) {
+			break;
+		}
+
+		// The slot may have been claimed before a slot which was already
+		// filled, wait for its producer to finish
+		struct log_async_slot *slot =
+			&log_async.ring[pos & (LOG_ASYNC_RING_SIZE - 1)];
+		while (atomic_load_explicit(&slot->seq, memory_order_acquire) !=
+				pos + 1) {
+			sched_yield();
+		}
+
+		uint_fast64_t dropped = atomic_exchange_explicit(&log_async.dropped, 0,
+			memory_order_relaxed);
+		if (dropped > 0) {
+			log_printf(L_ERROR, slot->time, "%"PRIuFAST64" log messages "
+				"dropped", dropped);
+		}
+		log_printf(slot->verbosity, slot->time, "%s", slot->message);
+
+		atomic_store_explicit(&slot->seq, pos + LOG_ASYNC_RING_SIZE,
+			memory_order_release);
+		log_async.dequeue_pos = pos + 1;
+	}
+	return NULL;
+}
+
+bool wlr_log_init_async(log_importance_t verbosity) {
+	if (log_async.running) {
+		wlr_log_init(verbosity, NULL);
+		return true;
+	}
+
+	log_async.ring = calloc(LOG_ASYNC_RING_SIZE, sizeof(log_async.ring[0]));
+	if (log_async.ring == NULL) {
+		return false;
+	}
+	for (size_t i = 0; i < LOG_ASYNC_RING_SIZE; ++i) {
+		atomic_init(&log_async.ring[i].seq, i);
+	}
+	atomic_init(&log_async.enqueue_pos, 0);
+	log_async.dequeue_pos = 0;
+	atomic_init(&log_async.dropped, 0);
+	atomic_init(&log_async.stopping, false);
+
+	if (sem_init(&log_async.sem, 0, 0) != 0) {
+		goto error_ring;
+	}
+	if (pthread_create(&log_async.thread, NULL, log_async_run, NULL) != 0) {
+		goto error_sem;
+	}
+	log_async.running = true;
+
+	wlr_log_init(verbosity, log_async_callback);
+	return true;
+
+error_sem:
+	sem_destroy(&log_async.sem);
+error_ring:
+	free(log_async.ring);
+	log_async.ring = NULL;
+	return false;
+}
+
+void wlr_log_finish_async(void) {
+	if (!log_async.running) {
+		return;
+	}
+
+	log_callback = wlr_log_stderr;
+
+	atomic_store(&log_async.stopping, true);
+	sem_post(&log_async.sem);
+	pthread_join(log_async.thread, NULL);
+	log_async.running = false;
+
+	uint_fast64_t dropped = atomic_load(&log_async.dropped);
+	if (dropped > 0) {
+		log_printf(L_ERROR, time(NULL), "%"PRIuFAST64" log messages dropped",
+			dropped);
+	}
+
+	sem_destroy(&log_async.sem);
+	free(log_async.ring);
+	log_async.ring = NULL;
+}
+
 void _wlr_vlog(log_importance_t verbosity, const char *fmt, va_list args) {
 	log_callback(verbosity, fmt, args);
 }
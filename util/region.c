@@ -1,4 +1,6 @@
 #include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <wlr/util/region.h>
 
@@ -128,3 +130,102 @@ void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
 	pixman_region32_init_rects(dst, dst_rects, nrects);
 	free(dst_rects);
 }
+
+static int64_t box_area(const pixman_box32_t *box) {
+	return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static int64_t box_intersection_area(const pixman_box32_t *a,
+		const pixman_box32_t *b) {
+	pixman_box32_t box = {
+		.x1 = a->x1 > b->x1 ? a->x1 : b->x1,
+		.y1 = a->y1 > b->y1 ? a->y1 : b->y1,
+		.x2 = a->x2 < b->x2 ? a->x2 : b->x2,
+		.y2 = a->y2 < b->y2 ? a->y2 : b->y2,
+	};
+	if (box.x1 >= box.x2 || box.y1 >= box.y2) {
+		return 0;
+	}
+	return box_area(&box);
+}
+
+/**
+ * Replaces `a` with the bounding box of `a` and `b` if it covers at most
+ * `rect_cost` more pixels than their union.
+ */
+static bool merge_boxes(pixman_box32_t *a, const pixman_box32_t *b,
+		int rect_cost) {
+	pixman_box32_t bounds = {
+		.x1 = a->x1 < b->x1 ? a->x1 : b->x1,
+		.y1 = a->y1 < b->y1 ? a->y1 : b->y1,
+		.x2 = a->x2 > b->x2 ? a->x2 : b->x2,
+		.y2 = a->y2 > b->y2 ? a->y2 : b->y2,
+	};
+	int64_t waste = box_area(&bounds) - box_area(a) - box_area(b) +
+		box_intersection_area(a, b);
+	if (waste > rect_cost) {
+		return false;
+	}
+	*a = bounds;
+	return true;
+}
+
+void wlr_region_simplify(pixman_region32_t *dst, pixman_region32_t *src,
+		int rect_cost, int max_rects) {
+	int nrects;
+	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
+	if (nrects <= 1) {
+		pixman_region32_copy(dst, src);
+		return;
+	}
+
+	// dst may be src
+	pixman_box32_t extents = *pixman_region32_extents(src);
+
+	pixman_box32_t *rects = malloc(nrects * sizeof(pixman_box32_t));
+	if (rects == NULL) {
+		pixman_region32_fini(dst);
+		pixman_region32_init_rect(dst, extents.x1, extents.y1,
+			extents.x2 - extents.x1, extents.y2 - extents.y1);
+		return;
+	}
+
+	// Rectangles are sorted in bands: merging each one with the previous one
+	// is linear and takes care of most fragmented damage
+	int n = 0;
+	for (int i = 0; i < nrects; ++i) {
+		if (n > 0 && merge_boxes(&rects[n - 1], &src_rects[i], rect_cost)) {
+			continue;
+		}
+		rects[n++] = src_rects[i];
+	}
+
+	if (n <= max_rects) {
+		bool merged = true;
+		while (merged) {
+			merged = false;
+			for (int i = 0; i < n; ++i) {
+				for (int j = i + 1; j < n; ++j) {
+					if (merge_boxes(&rects[i], &rects[j], rect_cost)) {
+						rects[j] = rects[n - 1];
+						--n;
+						--j;
+						merged = true;
+					}
+				}
+			}
+		}
+	}
+
+	pixman_region32_fini(dst);
+	pixman_region32_init_rects(dst, rects, n);
+	free(rects);
+
+	// Merged boxes can overlap, in which case the region is split into more
+	// rectangles than there are boxes
+	if (pixman_region32_n_rects(dst) > max_rects) {
+		pixman_region32_fini(dst);
+		pixman_region32_init_rect(dst, extents.x1, extents.y1,
+			extents.x2 - extents.x1, extents.y2 - extents.y1);
+	}
+}
@@ -24,6 +24,7 @@
  */
 
 #define _XOPEN_SOURCE 500
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,6 +33,19 @@
 #include <wlr/xcursor.h>
 #include "xcursor/xcursor.h"
 
+#define XCURSOR_THEME_BUCKETS 256
+
+struct wlr_xcursor_theme_entry {
+	char *name;
+	// Candidate files, from the theme then from the themes it inherits. Empty
+	// for built-in cursors.
+	char **paths;
+	size_t path_count;
+	bool loaded;
+	struct wlr_xcursor *cursor; // NULL if not loaded or invalid
+	struct wlr_xcursor_theme_entry *next; // in the same bucket
+};
+
 static void wlr_xcursor_destroy(struct wlr_xcursor *cursor) {
 	for (size_t i = 0; i < cursor->image_count; i++) {
 		free(cursor->images[i]->buffer);
@@ -43,6 +57,75 @@ static void wlr_xcursor_destroy(struct wlr_xcursor *cursor) {
 	free(cursor);
 }
 
+static uint32_t theme_name_hash(const char *name) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (const char *c = name; *c != '\0'; ++c) {
+		hash ^= (uint8_t)*c;
+		hash *= 16777619u;
+	}
+	return hash & (XCURSOR_THEME_BUCKETS - 1);
+}
+
+static struct wlr_xcursor_theme_entry *theme_find_entry(
+		struct wlr_xcursor_theme *theme, const char *name) {
+	struct wlr_xcursor_theme_entry *entry =
+		theme->entries[theme_name_hash(name)];
+	for (; entry != NULL; entry = entry->next) {
+		if (strcmp(name, entry->name) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static struct wlr_xcursor_theme_entry *theme_add_entry(
+		struct wlr_xcursor_theme *theme, const char *name) {
+	struct wlr_xcursor_theme_entry *entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		return NULL;
+	}
+	entry->name = strdup(name);
+	if (entry->name == NULL) {
+		free(entry);
+		return NULL;
+	}
+
+	uint32_t hash = theme_name_hash(name);
+	entry->next = theme->entries[hash];
+	theme->entries[hash] = entry;
+	theme->entry_count++;
+	return entry;
+}
+
+static bool theme_entry_add_path(struct wlr_xcursor_theme_entry *entry,
+		const char *path) {
+	char **paths = realloc(entry->paths,
+		(entry->path_count + 1) * sizeof(entry->paths[0]));
+	if (paths == NULL) {
+		return false;
+	}
+	entry->paths = paths;
+	entry->paths[entry->path_count] = strdup(path);
+	if (entry->paths[entry->path_count] == NULL) {
+		return false;
+	}
+	entry->path_count++;
+	return true;
+}
+
+static bool theme_add_cursor(struct wlr_xcursor_theme *theme,
+		struct wlr_xcursor *cursor) {
+	struct wlr_xcursor **cursors = realloc(theme->cursors,
+		(theme->cursor_count + 1) * sizeof(theme->cursors[0]));
+	if (cursors == NULL) {
+		return false;
+	}
+	theme->cursors = cursors;
+	theme->cursors[theme->cursor_count++] = cursor;
+	return true;
+}
+
 #include "xcursor/cursor_data.h"
 
 static struct wlr_xcursor *wlr_xcursor_create_from_data(
@@ -102,32 +185,33 @@ err_free_cursor:
 }
 
 static void load_default_theme(struct wlr_xcursor_theme *theme) {
-	uint32_t i;
-
 	free(theme->name);
 	theme->name = strdup("default");
 
-	theme->cursor_count = sizeof(cursor_metadata) / sizeof(cursor_metadata[0]);
-	theme->cursors = malloc(theme->cursor_count * sizeof(*theme->cursors));
-
-	if (theme->cursors == NULL) {
-		theme->cursor_count = 0;
-		return;
-	}
-
-	for (i = 0; i < theme->cursor_count; ++i) {
-		theme->cursors[i] =
+	size_t count = sizeof(cursor_metadata) / sizeof(cursor_metadata[0]);
+	for (size_t i = 0; i < count; ++i) {
+		struct wlr_xcursor *cursor =
 			wlr_xcursor_create_from_data(&cursor_metadata[i], theme);
-
-		if (theme->cursors[i] == NULL) {
+		if (cursor == NULL) {
+			break;
+		}
+		struct wlr_xcursor_theme_entry *entry =
+			theme_add_entry(theme, cursor->name);
+		if (entry == NULL) {
+			wlr_xcursor_destroy(cursor);
+			break;
+		}
+		entry->loaded = true;
+		if (!theme_add_cursor(theme, cursor)) {
+			wlr_xcursor_destroy(cursor);
 			break;
 		}
+		entry->cursor = cursor;
 	}
-	theme->cursor_count = i;
 }
 
 static struct wlr_xcursor *wlr_xcursor_create_from_xcursor_images(
-		XcursorImages *images, struct wlr_xcursor_theme *theme) {
+		XcursorImages *images, const char *name) {
 	struct wlr_xcursor *cursor;
 	struct wlr_xcursor_image *image;
 	int i, size;
@@ -143,7 +227,7 @@ static struct wlr_xcursor *wlr_xcursor_create_from_xcursor_images(
 		return NULL;
 	}
 
-	cursor->name = strdup(images->name);
+	cursor->name = strdup(name);
 	cursor->total_delay = 0;
 
 	for (i = 0; i < images->nimage; i++) {
@@ -184,38 +268,50 @@ static struct wlr_xcursor *wlr_xcursor_create_from_xcursor_images(
 	return cursor;
 }
 
-static void load_callback(XcursorImages *images, void *data) {
-	struct wlr_xcursor_theme *theme = data;
-	struct wlr_xcursor *cursor;
-
-	if (wlr_xcursor_theme_get_cursor(theme, images->name)) {
-		XcursorImagesDestroy(images);
-		return;
+/**
+ * Loads a built-in cursor, used when none of the theme files for a cursor can
+ * be decoded.
+ */
+static struct wlr_xcursor *load_default_cursor(struct wlr_xcursor_theme *theme,
+		const char *name) {
+	size_t count = sizeof(cursor_metadata) / sizeof(cursor_metadata[0]);
+	for (size_t i = 0; i < count; ++i) {
+		if (strcmp(name, cursor_metadata[i].name) != 0) {
+			continue;
+		}
+		struct wlr_xcursor *cursor =
+			wlr_xcursor_create_from_data(&cursor_metadata[i], theme);
+		if (cursor == NULL) {
+			return NULL;
+		}
+		if (!theme_add_cursor(theme, cursor)) {
+			wlr_xcursor_destroy(cursor);
+			return NULL;
+		}
+		return cursor;
 	}
+	return NULL;
+}
 
-	cursor = wlr_xcursor_create_from_xcursor_images(images, theme);
-
-	if (cursor) {
-		theme->cursor_count++;
-		theme->cursors =
-			realloc(theme->cursors,
-				theme->cursor_count * sizeof(theme->cursors[0]));
+static void index_callback(const char *name, const char *path, void *data) {
+	struct wlr_xcursor_theme *theme = data;
 
-		if (theme->cursors == NULL) {
-			theme->cursor_count--;
-			free(cursor);
-		} else {
-			theme->cursors[theme->cursor_count - 1] = cursor;
+	// Earlier themes take precedence over the themes they inherit, the files
+	// of the latter are only used if the former can't be decoded
+	struct wlr_xcursor_theme_entry *entry = theme_find_entry(theme, name);
+	if (entry == NULL) {
+		entry = theme_add_entry(theme, name);
+		if (entry == NULL) {
+			return;
 		}
 	}
-
-	XcursorImagesDestroy(images);
+	theme_entry_add_path(entry, path);
 }
 
 struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
 	struct wlr_xcursor_theme *theme;
 
-	theme = malloc(sizeof(*theme));
+	theme = calloc(1, sizeof(*theme));
 	if (!theme) {
 		return NULL;
 	}
@@ -229,27 +325,24 @@ struct wlr_xcursor_theme *wlr_xcursor_theme_load(const char *name, int size) {
 		goto out_error_name;
 	}
 	theme->size = size;
-	theme->cursor_count = 0;
-	theme->cursors = NULL;
+	theme->entries = calloc(XCURSOR_THEME_BUCKETS, sizeof(theme->entries[0]));
+	if (!theme->entries) {
+		goto out_error_entries;
+	}
 
-	xcursor_load_theme(name, size, load_callback, theme);
+	xcursor_index_theme(name, index_callback, theme);
 
-	if (theme->cursor_count == 0) {
+	if (theme->entry_count == 0) {
 		load_default_theme(theme);
 	}
 
-	wlr_log(L_DEBUG, "Loaded cursor theme '%s', available cursors:",
-			theme->name);
-	for (size_t i = 0; i < theme->cursor_count; ++i) {
-		struct wlr_xcursor *c = theme->cursors[i];
-		struct wlr_xcursor_image *i = c->images[0];
-		wlr_log(L_DEBUG, "%s (%u images) %dx%d+%d,%d",
-				c->name, c->image_count,
-				i->width, i->height, i->hotspot_x, i->hotspot_y);
-	}
+	wlr_log(L_DEBUG, "Indexed cursor theme '%s', %u cursors available",
+			theme->name, theme->entry_count);
 
 	return theme;
 
+out_error_entries:
+	free(theme->name);
 out_error_name:
 	free(theme);
 	return NULL;
@@ -262,6 +355,21 @@ void wlr_xcursor_theme_destroy(struct wlr_xcursor_theme *theme) {
 		wlr_xcursor_destroy(theme->cursors[i]);
 	}
 
+	for (i = 0; i < XCURSOR_THEME_BUCKETS; i++) {
+		struct wlr_xcursor_theme_entry *entry = theme->entries[i];
+		while (entry != NULL) {
+			struct wlr_xcursor_theme_entry *next = entry->next;
+			free(entry->name);
+			for (size_t j = 0; j < entry->path_count; j++) {
+				free(entry->paths[j]);
+			}
+			free(entry->paths);
+			free(entry);
+			entry = next;
+		}
+	}
+
+	free(theme->entries);
 	free(theme->name);
 	free(theme->cursors);
 	free(theme);
@@ -269,15 +377,49 @@ void wlr_xcursor_theme_destroy(struct wlr_xcursor_theme *theme) {
 
 struct wlr_xcursor *wlr_xcursor_theme_get_cursor(struct wlr_xcursor_theme *theme,
 		const char *name) {
-	unsigned int i;
+	struct wlr_xcursor_theme_entry *entry = theme_find_entry(theme, name);
+	if (entry == NULL) {
+		return NULL;
+	}
+	if (entry->loaded) {
+		return entry->cursor;
+	}
 
-	for (i = 0; i < theme->cursor_count; i++) {
-		if (strcmp(name, theme->cursors[i]->name) == 0) {
-			return theme->cursors[i];
+	// Only try once, invalid cursor files aren't read again
+	entry->loaded = true;
+
+	struct wlr_xcursor *cursor = NULL;
+	for (size_t i = 0; i < entry->path_count && cursor == NULL; i++) {
+		XcursorImages *images = XcursorFilenameLoadImages(entry->paths[i],
+			theme->size);
+		if (images == NULL) {
+			wlr_log(L_DEBUG, "Failed to load cursor '%s' from %s",
+				name, entry->paths[i]);
+			continue;
+		}
+		cursor = wlr_xcursor_create_from_xcursor_images(images, entry->name);
+		XcursorImagesDestroy(images);
+		if (cursor != NULL && !theme_add_cursor(theme, cursor)) {
+			wlr_xcursor_destroy(cursor);
+			return NULL;
 		}
 	}
 
-	return NULL;
+	if (cursor == NULL) {
+		cursor = load_default_cursor(theme, name);
+		if (cursor == NULL) {
+			return NULL;
+		}
+		wlr_log(L_DEBUG, "Using built-in cursor '%s'", name);
+	}
+
+	struct wlr_xcursor_image *image = cursor->images[0];
+	wlr_log(L_DEBUG, "Loaded cursor '%s' (%u images) %dx%d+%d,%d",
+		cursor->name, cursor->image_count,
+		image->width, image->height, image->hotspot_x, image->hotspot_y);
+
+	entry->cursor = cursor;
+	return cursor;
 }
 
 static int wlr_xcursor_frame_and_duration(struct wlr_xcursor *cursor,
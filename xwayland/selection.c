@@ -1,5 +1,6 @@
 #define _XOPEN_SOURCE 700
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,7 +32,8 @@ static void xwm_selection_send_notify(struct wlr_xwm_selection *selection,
 		(char *)&selection_notify);
 }
 
-static int xwm_selection_flush_source_data(struct wlr_xwm_selection *selection) {
+static void xwm_selection_flush_source_data(
+		struct wlr_xwm_selection *selection) {
 	xcb_change_property(selection->xwm->xcb_conn,
 		XCB_PROP_MODE_REPLACE,
 		selection->request.requestor,
@@ -41,113 +43,141 @@ static int xwm_selection_flush_source_data(struct wlr_xwm_selection *selection)
 		selection->source_data.size,
 		selection->source_data.data);
 	selection->property_set = true;
-	int length = selection->source_data.size;
 	selection->source_data.size = 0;
+}
 
-	return length;
+static void xwm_data_source_close(struct wlr_xwm_selection *selection) {
+	if (selection->source_event_source != NULL) {
+		wl_event_source_remove(selection->source_event_source);
+		selection->source_event_source = NULL;
+	}
+	if (selection->source_fd >= 0) {
+		close(selection->source_fd);
+		selection->source_fd = -1;
+	}
 }
 
-static int xwm_read_data_source(int fd, uint32_t mask, void *data) {
-	struct wlr_xwm_selection *selection = data;
+static void xwm_data_source_finish(struct wlr_xwm_selection *selection) {
+	xwm_data_source_close(selection);
+	wl_array_release(&selection->source_data);
+	wl_array_init(&selection->source_data);
+	selection->incr = 0;
+	selection->request.requestor = XCB_NONE;
+}
+
+static int xwm_read_data_source(int fd, uint32_t mask, void *data);
+
+/**
+ * Advances an incremental transfer. A chunk is sent whenever the requestor has
+ * deleted the previous one. The data source is only read while the buffer has
+ * room, so a slow requestor blocks the source instead of growing the buffer.
+ */
+static void xwm_data_source_update(struct wlr_xwm_selection *selection) {
 	struct wlr_xwm *xwm = selection->xwm;
 
-	void *p;
-	int current = selection->source_data.size;
-	if (selection->source_data.size < incr_chunk_size) {
-		p = wl_array_add(&selection->source_data, incr_chunk_size);
-		if (!p){
-			wlr_log(L_ERROR, "Could not allocate selection source_data");
-			goto error_out;
+	if (!selection->property_set) {
+		if (selection->source_data.size > 0) {
+			xwm_selection_flush_source_data(selection);
+		} else if (selection->source_eof) {
+			// A zero-length chunk ends the transfer
+			wlr_log(L_DEBUG, "incr transfer complete");
+			xwm_selection_flush_source_data(selection);
+			xcb_flush(xwm->xcb_conn);
+			xwm_data_source_finish(selection);
+			return;
 		}
-	} else {
-		p = (char *) selection->source_data.data + selection->source_data.size;
 	}
 
-	int available = selection->source_data.alloc - current;
+	bool readable = !selection->source_eof &&
+		selection->source_data.size < selection->source_data.alloc;
+	if (readable && selection->source_event_source == NULL) {
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(xwm->xwayland->wl_display);
+		selection->source_event_source = wl_event_loop_add_fd(loop,
+			selection->source_fd, WL_EVENT_READABLE, xwm_read_data_source,
+			selection);
+	} else if (!readable && selection->source_event_source != NULL) {
+		wl_event_source_remove(selection->source_event_source);
+		selection->source_event_source = NULL;
+	}
+
+	xcb_flush(xwm->xcb_conn);
+}
+
+static void xwm_data_source_start_incr(struct wlr_xwm_selection *selection) {
+	struct wlr_xwm *xwm = selection->xwm;
+
+	wlr_log(L_DEBUG, "data source larger than %zu bytes, starting incr",
+		incr_chunk_size);
+	selection->incr = 1;
 
-	int len = read(fd, p, available);
+	// Chunks are sent when the requestor deletes the property. Use the same
+	// event mask as for managed windows, the requestor may be one of them.
+	uint32_t values[] = {
+		XCB_EVENT_MASK_FOCUS_CHANGE | XCB_EVENT_MASK_PROPERTY_CHANGE,
+	};
+	xcb_change_window_attributes(xwm->xcb_conn, selection->request.requestor,
+		XCB_CW_EVENT_MASK, values);
+
+	uint32_t size_hint = incr_chunk_size;
+	xcb_change_property(xwm->xcb_conn,
+		XCB_PROP_MODE_REPLACE,
+		selection->request.requestor,
+		selection->request.property,
+		xwm->atoms[INCR],
+		32, // format
+		1, &size_hint);
+	selection->property_set = true;
+	xwm_selection_send_notify(selection, selection->request.property);
+}
+
+static int xwm_read_data_source(int fd, uint32_t mask, void *data) {
+	struct wlr_xwm_selection *selection = data;
+	struct wlr_xwm *xwm = selection->xwm;
+
+	// The buffer is allocated once, data is never read past its end
+	size_t available =
+		selection->source_data.alloc - selection->source_data.size;
+	char *p = (char *)selection->source_data.data + selection->source_data.size;
+	ssize_t len = read(fd, p, available);
 	if (len == -1) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return 0;
+		}
 		wlr_log(L_ERROR, "read error from data source: %m");
-		goto error_out;
+		if (!selection->incr) {
+			xwm_selection_send_notify(selection, XCB_ATOM_NONE);
+			xcb_flush(xwm->xcb_conn);
+			xwm_data_source_finish(selection);
+			return 0;
+		}
+		// Terminate the transfer with what has been read so far
+		len = 0;
 	}
 
-	wlr_log(L_DEBUG, "read %d (available %d, mask 0x%x) bytes: \"%.*s\"",
-			len, available, mask, len, (char *) p);
-
-	selection->source_data.size = current + len;
-	if (selection->source_data.size >= incr_chunk_size) {
-		if (!selection->incr) {
-			wlr_log(L_DEBUG, "got %zu bytes, starting incr",
-					selection->source_data.size);
-			selection->incr = 1;
-			xcb_change_property(xwm->xcb_conn,
-					XCB_PROP_MODE_REPLACE,
-					selection->request.requestor,
-					selection->request.property,
-					xwm->atoms[INCR],
-					32, /* format */
-					1, &incr_chunk_size);
-			selection->property_set = true;
-			selection->flush_property_on_delete = 1;
-			wl_event_source_remove(selection->property_source);
-			selection->property_source = NULL;
-			xwm_selection_send_notify(selection, selection->request.property);
-		} else if (selection->property_set) {
-			wlr_log(L_DEBUG, "got %zu bytes, waiting for "
-				"property delete", selection->source_data.size);
+	selection->source_data.size += len;
+	if (len == 0) {
+		selection->source_eof = true;
+		xwm_data_source_close(selection);
+	}
 
-			selection->flush_property_on_delete = 1;
-			wl_event_source_remove(selection->property_source);
-			selection->property_source = NULL;
-		} else {
-			wlr_log(L_DEBUG, "got %zu bytes, "
-				"property deleted, setting new property",
-				selection->source_data.size);
+	if (!selection->incr) {
+		if (selection->source_eof) {
+			wlr_log(L_DEBUG, "non-incr transfer complete");
 			xwm_selection_flush_source_data(selection);
+			xwm_selection_send_notify(selection, selection->request.property);
+			xcb_flush(xwm->xcb_conn);
+			xwm_data_source_finish(selection);
+			return 1;
 		}
-	} else if (len == 0 && !selection->incr) {
-		wlr_log(L_DEBUG, "non-incr transfer complete");
-		/* Non-incr transfer all done. */
-		xwm_selection_flush_source_data(selection);
-		xwm_selection_send_notify(selection, selection->request.property);
-		xcb_flush(xwm->xcb_conn);
-		wl_event_source_remove(selection->property_source);
-		selection->property_source = NULL;
-		close(fd);
-		wl_array_release(&selection->source_data);
-		selection->request.requestor = XCB_NONE;
-	} else if (len == 0 && selection->incr) {
-		wlr_log(L_DEBUG, "incr transfer complete");
-
-		selection->flush_property_on_delete = 1;
-		if (selection->property_set) {
-			wlr_log(L_DEBUG, "got %zu bytes, waiting for "
-					"property delete", selection->source_data.size);
-		} else {
-			wlr_log(L_DEBUG, "got %zu bytes, "
-					"property deleted, setting new property",
-					selection->source_data.size);
-			xwm_selection_flush_source_data(selection);
+		if (selection->source_data.size < selection->source_data.alloc) {
+			return 1;
 		}
-		xcb_flush(xwm->xcb_conn);
-		wl_event_source_remove(selection->property_source);
-		selection->property_source = NULL;
-		close(selection->source_fd);
-		selection->source_fd = -1;
-		close(fd);
-	} else {
-		wlr_log(L_DEBUG, "nothing happened, buffered the bytes");
+		xwm_data_source_start_incr(selection);
 	}
 
+	xwm_data_source_update(selection);
 	return 1;
-
-error_out:
-	xwm_selection_send_notify(selection, XCB_ATOM_NONE);
-	wl_event_source_remove(selection->property_source);
-	selection->property_source = NULL;
-	close(fd);
-	wl_array_release(&selection->source_data);
-	return 0;
 }
 
 static void xwm_selection_source_send(struct wlr_xwm_selection *selection,
@@ -173,6 +203,9 @@ static void xwm_selection_source_send(struct wlr_xwm_selection *selection,
 
 static void xwm_selection_send_data(struct wlr_xwm_selection *selection,
 		xcb_atom_t target, const char *mime_type) {
+	// Abort the previous transfer, if any
+	xwm_data_source_close(selection);
+
 	int p[2];
 	if (pipe(p) == -1) {
 		wlr_log(L_ERROR, "pipe failed: %m");
@@ -185,12 +218,25 @@ static void xwm_selection_send_data(struct wlr_xwm_selection *selection,
 	fcntl(p[1], F_SETFD, FD_CLOEXEC);
 	fcntl(p[1], F_SETFL, O_NONBLOCK);
 
+	// Data is buffered one chunk at a time
+	wl_array_release(&selection->source_data);
 	wl_array_init(&selection->source_data);
+	if (wl_array_add(&selection->source_data, incr_chunk_size) == NULL) {
+		wlr_log(L_ERROR, "Could not allocate selection source_data");
+		xwm_selection_send_notify(selection, XCB_ATOM_NONE);
+		close(p[0]);
+		close(p[1]);
+		return;
+	}
+	selection->source_data.size = 0;
+
 	selection->target = target;
 	selection->source_fd = p[0];
+	selection->source_eof = false;
+	selection->property_set = false;
 	struct wl_event_loop *loop =
 		wl_display_get_event_loop(selection->xwm->xwayland->wl_display);
-	selection->property_source = wl_event_loop_add_fd(loop,
+	selection->source_event_source = wl_event_loop_add_fd(loop,
 		selection->source_fd,
 		WL_EVENT_READABLE,
 		xwm_read_data_source,
@@ -313,7 +359,6 @@ static void xwm_handle_selection_request(struct wlr_xwm *xwm,
 		struct wlr_xwm_selection *selection = &xwm->clipboard_selection;
 		selection->request = *selection_request;
 		selection->incr = 0;
-		selection->flush_property_on_delete = 0;
 		xwm_selection_send_notify(selection, selection->request.property);
 		return;
 	}
@@ -325,9 +370,9 @@ static void xwm_handle_selection_request(struct wlr_xwm *xwm,
 		return;
 	}
 
+	// A new request aborts the transfer in progress, if any
+	xwm_data_source_finish(selection);
 	selection->request = *selection_request;
-	selection->incr = 0;
-	selection->flush_property_on_delete = 0;
 
 	// No xwayland surface focused, deny access to clipboard
 	if (xwm->focus_surface == NULL) {
@@ -371,6 +416,25 @@ static void xwm_handle_selection_request(struct wlr_xwm *xwm,
 	}
 }
 
+static void xwm_data_target_finish(struct wlr_xwm_selection *selection) {
+	free(selection->property_reply);
+	selection->property_reply = NULL;
+	if (selection->target_event_source != NULL) {
+		wl_event_source_remove(selection->target_event_source);
+		selection->target_event_source = NULL;
+	}
+	if (selection->target_fd >= 0) {
+		close(selection->target_fd);
+		selection->target_fd = -1;
+	}
+	if (selection->property_pending) {
+		xcb_discard_reply(selection->xwm->xcb_conn,
+			selection->property_cookie.sequence);
+		selection->property_pending = false;
+	}
+	selection->incoming_incr = false;
+}
+
 static int writable_callback(int fd, uint32_t mask, void *data) {
 	struct wlr_xwm_selection *selection = data;
 	struct wlr_xwm *xwm = selection->xwm;
@@ -381,38 +445,38 @@ static int writable_callback(int fd, uint32_t mask, void *data) {
 
 	int len = write(fd, property + selection->property_start, remainder);
 	if (len == -1) {
-		free(selection->property_reply);
-		selection->property_reply = NULL;
-		if (selection->property_source) {
-			wl_event_source_remove(selection->property_source);
+		if (errno == EAGAIN || errno == EINTR) {
+			return 0;
 		}
-		selection->property_source = NULL;
-		close(fd);
 		wlr_log(L_ERROR, "write error to target fd: %m");
+		xwm_data_target_finish(selection);
 		return 1;
 	}
 
-	wlr_log(L_DEBUG, "wrote %d (chunk size %d) of %d bytes",
-		selection->property_start + len,
-		len, xcb_get_property_value_length(selection->property_reply));
-
 	selection->property_start += len;
-	if (len == remainder) {
-		free(selection->property_reply);
-		selection->property_reply = NULL;
-		if (selection->property_source) {
-			wl_event_source_remove(selection->property_source);
-		}
-		selection->property_source = NULL;
+	if (len < remainder) {
+		// Wait for the target to catch up
+		return 1;
+	}
 
-		if (selection->incr) {
-			xcb_delete_property(xwm->xcb_conn,
-				selection->window,
-				xwm->atoms[WL_SELECTION]);
-		} else {
-			wlr_log(L_DEBUG, "transfer complete");
-			close(fd);
-		}
+	free(selection->property_reply);
+	selection->property_reply = NULL;
+	if (selection->target_event_source) {
+		wl_event_source_remove(selection->target_event_source);
+	}
+	selection->target_event_source = NULL;
+
+	if (selection->incoming_incr) {
+		// Deleting the property asks the owner for the next chunk. It isn't
+		// deleted before the chunk has been written, so that a slow target
+		// slows down the owner.
+		xcb_delete_property(xwm->xcb_conn,
+			selection->window,
+			xwm->atoms[WL_SELECTION]);
+		xcb_flush(xwm->xcb_conn);
+	} else {
+		wlr_log(L_DEBUG, "transfer complete");
+		xwm_data_target_finish(selection);
 	}
 
 	return 1;
@@ -422,46 +486,139 @@ static void xwm_write_property(struct wlr_xwm_selection *selection,
 		xcb_get_property_reply_t *reply) {
 	selection->property_start = 0;
 	selection->property_reply = reply;
-	writable_callback(selection->source_fd, WL_EVENT_WRITABLE, selection);
+	writable_callback(selection->target_fd, WL_EVENT_WRITABLE, selection);
 
 	if (selection->property_reply) {
 		struct wl_event_loop *loop =
 			wl_display_get_event_loop(selection->xwm->xwayland->wl_display);
-		selection->property_source = wl_event_loop_add_fd(loop,
-			selection->source_fd, WL_EVENT_WRITABLE, writable_callback,
+		selection->target_event_source = wl_event_loop_add_fd(loop,
+			selection->target_fd, WL_EVENT_WRITABLE, writable_callback,
 			selection);
 	}
 }
 
-static void xwm_selection_get_data(struct wlr_xwm_selection *selection) {
+/**
+ * Requests the WL_SELECTION property without waiting for the reply, which is
+ * handled in xwm_selection_handle_property_reply.
+ */
+static void xwm_selection_request_property(
+		struct wlr_xwm_selection *selection, bool delete) {
 	struct wlr_xwm *xwm = selection->xwm;
 
-	xcb_get_property_cookie_t cookie = xcb_get_property(xwm->xcb_conn,
-		1, // delete
+	if (selection->property_pending) {
+		xcb_discard_reply(xwm->xcb_conn, selection->property_cookie.sequence);
+	}
+	selection->property_cookie = xcb_get_property(xwm->xcb_conn,
+		delete,
 		selection->window,
 		xwm->atoms[WL_SELECTION],
 		XCB_GET_PROPERTY_TYPE_ANY,
 		0, // offset
 		0x1fffffff // length
 		);
+	selection->property_pending = true;
+	xcb_flush(xwm->xcb_conn);
+}
 
-	xcb_get_property_reply_t *reply =
-		xcb_get_property_reply(xwm->xcb_conn, cookie, NULL);
-	if (reply == NULL) {
-		return;
-	}
+static void xwm_selection_get_data(struct wlr_xwm_selection *selection) {
+	selection->incoming_incr = false;
+	xwm_selection_request_property(selection, true);
+}
+
+static void xwm_selection_get_incr_chunk(struct wlr_xwm_selection *selection) {
+	xwm_selection_request_property(selection, false);
+}
 
-	if (reply->type == xwm->atoms[INCR]) {
-		selection->incr = 1;
+static void xwm_selection_handle_property_reply(
+		struct wlr_xwm_selection *selection, xcb_get_property_reply_t *reply) {
+	struct wlr_xwm *xwm = selection->xwm;
+
+	if (selection->incoming_incr) {
+		if (xcb_get_property_value_length(reply) > 0) {
+			xwm_write_property(selection, reply);
+		} else {
+			wlr_log(L_DEBUG, "incr transfer complete");
+			free(reply);
+			xwm_data_target_finish(selection);
+		}
+	} else if (reply->type == xwm->atoms[INCR]) {
+		// Deleting the INCR property starts the transfer, chunks are
+		// received in xwm_selection_get_incr_chunk
+		selection->incoming_incr = true;
 		free(reply);
 	} else {
-		selection->incr = 0;
 		// reply's ownership is transferred to wm, which is responsible
 		// for freeing it
 		xwm_write_property(selection, reply);
 	}
 }
 
+int xwm_handle_selection_replies(struct wlr_xwm *xwm) {
+	struct wlr_xwm_selection *selections[] = {
+		&xwm->clipboard_selection,
+		&xwm->primary_selection,
+	};
+
+	int count = 0;
+	for (size_t i = 0; i < sizeof(selections)/sizeof(selections[0]); ++i) {
+		struct wlr_xwm_selection *selection = selections[i];
+		if (!selection->property_pending) {
+			continue;
+		}
+
+		void *reply = NULL;
+		xcb_generic_error_t *error = NULL;
+		if (!xcb_poll_for_reply(xwm->xcb_conn,
+				selection->property_cookie.sequence, &reply, &error)) {
+			continue;
+		}
+		selection->property_pending = false;
+		count++;
+
+		free(error);
+		if (reply != NULL) {
+			xwm_selection_handle_property_reply(selection, reply);
+		} else {
+			wlr_log(L_DEBUG, "failed to get selection property");
+			xwm_data_target_finish(selection);
+		}
+	}
+	return count;
+}
+
+static int xwm_handle_selection_property_notify(struct wlr_xwm *xwm,
+		xcb_property_notify_event_t *event) {
+	struct wlr_xwm_selection *selections[] = {
+		&xwm->clipboard_selection,
+		&xwm->primary_selection,
+	};
+
+	for (size_t i = 0; i < sizeof(selections)/sizeof(selections[0]); ++i) {
+		struct wlr_xwm_selection *selection = selections[i];
+
+		if (event->window == selection->window &&
+				event->atom == xwm->atoms[WL_SELECTION] &&
+				event->state == XCB_PROPERTY_NEW_VALUE &&
+				selection->incoming_incr && selection->property_reply == NULL &&
+				!selection->property_pending) {
+			// The owner has sent a new chunk
+			xwm_selection_get_incr_chunk(selection);
+			return 1;
+		}
+
+		if (event->window == selection->request.requestor &&
+				event->atom == selection->request.property &&
+				event->state == XCB_PROPERTY_DELETE && selection->incr) {
+			// The requestor has consumed the previous chunk
+			selection->property_set = false;
+			xwm_data_source_update(selection);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 static void source_send(struct wlr_xwm_selection *selection,
 		struct wl_array *mime_types, struct wl_array *mime_types_atoms,
 		const char *requested_mime_type, int32_t fd) {
@@ -483,9 +640,13 @@ static void source_send(struct wlr_xwm_selection *selection,
 	}
 	if (!found) {
 		wlr_log(L_DEBUG, "cannot send X11 selection: unsupported MIME type");
+		close(fd);
 		return;
 	}
 
+	// Abort the previous transfer, if any
+	xwm_data_target_finish(selection);
+
 	xcb_convert_selection(xwm->xcb_conn,
 		selection->window,
 		selection->atom,
@@ -496,7 +657,7 @@ static void source_send(struct wlr_xwm_selection *selection,
 	xcb_flush(xwm->xcb_conn);
 
 	fcntl(fd, F_SETFL, O_WRONLY | O_NONBLOCK);
-	selection->source_fd = fd;
+	selection->target_fd = fd;
 }
 
 struct x11_data_source {
@@ -751,7 +912,7 @@ static int xwm_handle_xfixes_selection_notify(struct wlr_xwm *xwm,
 		return 1;
 	}
 
-	selection->incr = 0;
+	selection->incoming_incr = false;
 	// doing this will give a selection notify where we actually handle the sync
 	xcb_convert_selection(xwm->xcb_conn, selection->window,
 		selection->atom,
@@ -779,6 +940,9 @@ int xwm_handle_selection_event(struct wlr_xwm *xwm,
 	case XCB_SELECTION_REQUEST:
 		xwm_handle_selection_request(xwm, event);
 		return 1;
+	case XCB_PROPERTY_NOTIFY:
+		return xwm_handle_selection_property_notify(xwm,
+			(xcb_property_notify_event_t *)event);
 	}
 
 	switch (event->response_type - xwm->xfixes->first_event) {
@@ -796,6 +960,9 @@ static void selection_init(struct wlr_xwm *xwm,
 	selection->atom = atom;
 	selection->window = xwm->selection_window;
 	selection->request.requestor = XCB_NONE;
+	selection->source_fd = -1;
+	selection->target_fd = -1;
+	wl_array_init(&selection->source_data);
 
 	uint32_t mask =
 		XCB_XFIXES_SELECTION_EVENT_MASK_SET_SELECTION_OWNER |
@@ -828,10 +995,21 @@ void xwm_selection_init(struct wlr_xwm *xwm) {
 	selection_init(xwm, &xwm->primary_selection, xwm->atoms[PRIMARY]);
 }
 
+static void selection_finish(struct wlr_xwm_selection *selection) {
+	if (selection->xwm == NULL) {
+		// Not initialized
+		return;
+	}
+	xwm_data_target_finish(selection);
+	xwm_data_source_finish(selection);
+}
+
 void xwm_selection_finish(struct wlr_xwm *xwm) {
 	if (!xwm) {
 		return;
 	}
+	selection_finish(&xwm->clipboard_selection);
+	selection_finish(&xwm->primary_selection);
 	if (xwm->selection_window) {
 		xcb_destroy_window(xwm->xcb_conn, xwm->selection_window);
 	}
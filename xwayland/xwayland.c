@@ -144,6 +144,11 @@ static void wlr_xwayland_finish(struct wlr_xwayland *wlr_xwayland) {
 	if (wlr_xwayland->sigusr1_source) {
 		wl_event_source_remove(wlr_xwayland->sigusr1_source);
 	}
+	for (size_t i = 0; i < 2; ++i) {
+		if (wlr_xwayland->x_fd_read_event[i]) {
+			wl_event_source_remove(wlr_xwayland->x_fd_read_event[i]);
+		}
+	}
 
 	safe_close(wlr_xwayland->x_fd[0]);
 	safe_close(wlr_xwayland->x_fd[1]);
@@ -176,7 +181,8 @@ static void handle_client_destroy(struct wl_listener *listener, void *data) {
 
 	wlr_xwayland_finish(wlr_xwayland);
 
-	if (time(NULL) - wlr_xwayland->server_start > 5) {
+	// In lazy mode, restarting only binds the sockets again
+	if (wlr_xwayland->lazy || time(NULL) - wlr_xwayland->server_start > 5) {
 		wlr_log(L_INFO, "Restarting Xwayland");
 		wlr_xwayland_start(wlr_xwayland, wlr_xwayland->wl_display,
 			wlr_xwayland->compositor);
@@ -245,6 +251,23 @@ static int xserver_handle_ready(int signal_number, void *data) {
 	return 1; /* wayland event loop dispatcher's count */
 }
 
+static bool wlr_xwayland_start_server(struct wlr_xwayland *wlr_xwayland);
+
+static int xwayland_socket_connected(int fd, uint32_t mask, void *data) {
+	struct wlr_xwayland *wlr_xwayland = data;
+
+	for (size_t i = 0; i < 2; ++i) {
+		wl_event_source_remove(wlr_xwayland->x_fd_read_event[i]);
+		wlr_xwayland->x_fd_read_event[i] = NULL;
+	}
+
+	// The connection is left pending, Xwayland accepts it when it starts
+	// listening on the sockets
+	wlr_log(L_DEBUG, "X11 client connected, starting Xwayland");
+	wlr_xwayland_start_server(wlr_xwayland);
+	return 0;
+}
+
 static bool wlr_xwayland_start(struct wlr_xwayland *wlr_xwayland,
 		struct wl_display *wl_display, struct wlr_compositor *compositor) {
 	memset(wlr_xwayland, 0, offsetof(struct wlr_xwayland, seat));
@@ -262,6 +285,34 @@ static bool wlr_xwayland_start(struct wlr_xwayland *wlr_xwayland,
 		wlr_xwayland_finish(wlr_xwayland);
 		return false;
 	}
+
+	if (!wlr_xwayland->lazy) {
+		return wlr_xwayland_start_server(wlr_xwayland);
+	}
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(wl_display);
+	for (size_t i = 0; i < 2; ++i) {
+		wlr_xwayland->x_fd_read_event[i] = wl_event_loop_add_fd(loop,
+			wlr_xwayland->x_fd[i], WL_EVENT_READABLE,
+			xwayland_socket_connected, wlr_xwayland);
+		if (wlr_xwayland->x_fd_read_event[i] == NULL) {
+			wlr_log(L_ERROR, "Failed to listen on X11 socket");
+			wlr_xwayland_finish(wlr_xwayland);
+			return false;
+		}
+	}
+
+	// Clients can connect right away
+	char display_name[16];
+	snprintf(display_name, sizeof(display_name), ":%d", wlr_xwayland->display);
+	setenv("DISPLAY", display_name, true);
+
+	return true;
+}
+
+static bool wlr_xwayland_start_server(struct wlr_xwayland *wlr_xwayland) {
+	struct wl_display *wl_display = wlr_xwayland->wl_display;
+
 	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, wlr_xwayland->wl_fd) != 0 ||
 			socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, wlr_xwayland->wm_fd) != 0) {
 		wlr_log_errno(L_ERROR, "failed to create socketpair");
@@ -277,8 +328,11 @@ static bool wlr_xwayland_start(struct wlr_xwayland *wlr_xwayland,
 		return false;
 	}
 
-	// unset $DISPLAY while XWayland starts
-	unsetenv("DISPLAY");
+	// unset $DISPLAY while XWayland starts, unless clients are already
+	// waiting for it
+	if (!wlr_xwayland->lazy) {
+		unsetenv("DISPLAY");
+	}
 
 	wlr_xwayland->wl_fd[0] = -1; /* not ours anymore */
 
@@ -343,9 +397,10 @@ void wlr_xwayland_destroy(struct wlr_xwayland *wlr_xwayland) {
 }
 
 struct wlr_xwayland *wlr_xwayland_create(struct wl_display *wl_display,
-		struct wlr_compositor *compositor) {
+		struct wlr_compositor *compositor, bool lazy) {
 	struct wlr_xwayland *wlr_xwayland = calloc(1, sizeof(struct wlr_xwayland));
 
+	wlr_xwayland->lazy = lazy;
 	wl_signal_init(&wlr_xwayland->events.new_surface);
 	wl_signal_init(&wlr_xwayland->events.ready);
 	if (wlr_xwayland_start(wlr_xwayland, wl_display, compositor)) {
@@ -12,6 +12,7 @@
 #include <wlr/xwm.h>
 #include <xcb/composite.h>
 #include <xcb/render.h>
+#include <xcb/xcbext.h>
 #include <xcb/xcb_image.h>
 #include <xcb/xfixes.h>
 #include "util/signal.h"
@@ -56,12 +57,26 @@ const char *atom_map[ATOM_LAST] = {
 	"TIMESTAMP",
 };
 
+struct xwm_property_request {
+	struct wlr_xwayland_surface *xsurface;
+	xcb_atom_t property;
+	xcb_get_property_cookie_t cookie;
+	struct wl_list link; // wlr_xwm::property_requests
+};
+
 /* General helpers */
-// TODO: replace this with hash table?
+static size_t xwm_id_hash(uint32_t id) {
+	// X resource IDs and Wayland object IDs are allocated sequentially, mix
+	// the bits so that neighbouring IDs end up in distant buckets
+	return (id * 2654435761u) & (XWM_SURFACE_BUCKETS - 1);
+}
+
 static struct wlr_xwayland_surface *lookup_surface(struct wlr_xwm *xwm,
 		xcb_window_t window_id) {
+	struct wl_list *bucket =
+		&xwm->surfaces_by_window[xwm_id_hash(window_id)];
 	struct wlr_xwayland_surface *surface;
-	wl_list_for_each(surface, &xwm->surfaces, link) {
+	wl_list_for_each(surface, bucket, window_link) {
 		if (surface->window_id == window_id) {
 			return surface;
 		}
@@ -69,6 +84,28 @@ static struct wlr_xwayland_surface *lookup_surface(struct wlr_xwm *xwm,
 	return NULL;
 }
 
+static void xwm_add_unpaired_surface(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, uint32_t surface_id) {
+	if (xsurface->surface_id) {
+		wl_list_remove(&xsurface->unpaired_link);
+	}
+	xsurface->surface_id = surface_id;
+	wl_list_insert(&xwm->unpaired_surfaces[xwm_id_hash(surface_id)],
+		&xsurface->unpaired_link);
+}
+
+static struct wlr_xwayland_surface *lookup_unpaired_surface(
+		struct wlr_xwm *xwm, uint32_t surface_id) {
+	struct wl_list *bucket = &xwm->unpaired_surfaces[xwm_id_hash(surface_id)];
+	struct wlr_xwayland_surface *xsurface;
+	wl_list_for_each(xsurface, bucket, unpaired_link) {
+		if (xsurface->surface_id == surface_id) {
+			return xsurface;
+		}
+	}
+	return NULL;
+}
+
 static struct wlr_xwayland_surface *wlr_xwayland_surface_create(
 		struct wlr_xwm *xwm, xcb_window_t window_id, int16_t x, int16_t y,
 		uint16_t width, uint16_t height, bool override_redirect) {
@@ -97,6 +134,8 @@ static struct wlr_xwayland_surface *wlr_xwayland_surface_create(
 	surface->height = height;
 	surface->override_redirect = override_redirect;
 	wl_list_insert(&xwm->surfaces, &surface->link);
+	wl_list_insert(&xwm->surfaces_by_window[xwm_id_hash(window_id)],
+		&surface->window_link);
 	wl_list_init(&surface->children);
 	wl_list_init(&surface->parent_link);
 	wl_signal_init(&surface->events.destroy);
@@ -209,15 +248,31 @@ static void xsurface_set_net_wm_state(struct wlr_xwayland_surface *xsurface) {
 		i, property);
 }
 
+static void xwm_property_request_destroy(struct xwm_property_request *request) {
+	wl_list_remove(&request->link);
+	free(request);
+}
+
 static void wlr_xwayland_surface_destroy(
 		struct wlr_xwayland_surface *xsurface) {
 	wlr_signal_emit_safe(&xsurface->events.destroy, xsurface);
 
+	struct wlr_xwm *xwm = xsurface->xwm;
+	struct xwm_property_request *request, *request_tmp;
+	wl_list_for_each_safe(request, request_tmp, &xwm->property_requests,
+			link) {
+		if (request->xsurface == xsurface) {
+			xcb_discard_reply(xwm->xcb_conn, request->cookie.sequence);
+			xwm_property_request_destroy(request);
+		}
+	}
+
 	if (xsurface == xsurface->xwm->focus_surface) {
 		xwm_surface_activate(xsurface->xwm, NULL);
 	}
 
 	wl_list_remove(&xsurface->link);
+	wl_list_remove(&xsurface->window_link);
 	wl_list_remove(&xsurface->parent_link);
 
 	if (xsurface->surface_id) {
@@ -492,15 +547,8 @@ static void read_surface_net_wm_state(struct wlr_xwm *xwm,
 }
 
 static void read_surface_property(struct wlr_xwm *xwm,
-		struct wlr_xwayland_surface *xsurface, xcb_atom_t property) {
-	xcb_get_property_cookie_t cookie = xcb_get_property(xwm->xcb_conn, 0,
-		xsurface->window_id, property, XCB_ATOM_ANY, 0, 2048);
-	xcb_get_property_reply_t *reply = xcb_get_property_reply(xwm->xcb_conn,
-		cookie, NULL);
-	if (reply == NULL) {
-		return;
-	}
-
+		struct wlr_xwayland_surface *xsurface, xcb_atom_t property,
+		xcb_get_property_reply_t *reply) {
 	if (property == XCB_ATOM_WM_CLASS) {
 		read_surface_class(xwm, xsurface, reply);
 	} else if (property == XCB_ATOM_WM_NAME ||
@@ -525,27 +573,91 @@ static void read_surface_property(struct wlr_xwm *xwm,
 	} else {
 		wlr_log(L_DEBUG, "unhandled x11 property %u", property);
 	}
-
-	free(reply);
 }
 
-static void handle_surface_commit(struct wlr_surface *wlr_surface,
-		void *role_data) {
-	struct wlr_xwayland_surface *xsurface = role_data;
+/**
+ * Sends a property request without waiting for its reply. Replies are
+ * collected by xwm_handle_property_replies.
+ */
+static void xwm_request_surface_property(struct wlr_xwm *xwm,
+		struct wlr_xwayland_surface *xsurface, xcb_atom_t property) {
+	struct xwm_property_request *request =
+		calloc(1, sizeof(struct xwm_property_request));
+	if (request == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return;
+	}
+	request->xsurface = xsurface;
+	request->property = property;
+	request->cookie = xcb_get_property(xwm->xcb_conn, 0,
+		xsurface->window_id, property, XCB_ATOM_ANY, 0, 2048);
+	wl_list_insert(xwm->property_requests.prev, &request->link);
+	xsurface->pending_properties++;
+}
 
+static void xwm_surface_add(struct wlr_xwayland_surface *xsurface) {
 	if (!xsurface->added &&
 			wlr_surface_has_buffer(xsurface->surface) &&
 			xsurface->mapped) {
-		wlr_signal_emit_safe(&xsurface->xwm->xwayland->events.new_surface, xsurface);
+		wlr_signal_emit_safe(&xsurface->xwm->xwayland->events.new_surface,
+			xsurface);
 		xsurface->added = true;
 	}
 }
 
+static void xwm_surface_map(struct wlr_xwayland_surface *xsurface) {
+	xsurface->map_pending = false;
+	xsurface->mapped = true;
+	wlr_signal_emit_safe(&xsurface->events.map_notify, xsurface);
+	// The surface may have committed a buffer while properties were pending
+	xwm_surface_add(xsurface);
+}
+
+static int xwm_handle_property_replies(struct wlr_xwm *xwm) {
+	int count = 0;
+	// Replies come in request order, stop at the first one not received yet
+	while (!wl_list_empty(&xwm->property_requests)) {
+		struct xwm_property_request *request = wl_container_of(
+			xwm->property_requests.next, request, link);
+		void *reply = NULL;
+		xcb_generic_error_t *error = NULL;
+		if (!xcb_poll_for_reply(xwm->xcb_conn, request->cookie.sequence,
+				&reply, &error)) {
+			break;
+		}
+		count++;
+
+		struct wlr_xwayland_surface *xsurface = request->xsurface;
+		xcb_atom_t property = request->property;
+		xwm_property_request_destroy(request);
+		xsurface->pending_properties--;
+
+		if (reply != NULL) {
+			read_surface_property(xwm, xsurface, property, reply);
+			free(reply);
+		}
+		free(error);
+
+		if (xsurface->map_pending && xsurface->pending_properties == 0) {
+			xwm_surface_map(xsurface);
+		}
+	}
+	return count;
+}
+
+static void handle_surface_commit(struct wlr_surface *wlr_surface,
+		void *role_data) {
+	struct wlr_xwayland_surface *xsurface = role_data;
+	xwm_surface_add(xsurface);
+}
+
 static void handle_surface_destroy(struct wl_listener *listener, void *data) {
 	struct wlr_xwayland_surface *xsurface =
 		wl_container_of(listener, xsurface, surface_destroy);
 
 	xsurface->surface = NULL;
+	// Don't map a surface without a wlr_surface when the replies come in
+	xsurface->map_pending = false;
 	// TODO destroy xwayland surface?
 }
 
@@ -554,7 +666,8 @@ static void xwm_map_shell_surface(struct wlr_xwm *xwm,
 		struct wlr_surface *surface) {
 	xsurface->surface = surface;
 
-	// read all surface properties
+	// Request all surface properties at once, the surface is mapped when all
+	// replies have been received
 	const xcb_atom_t props[] = {
 		XCB_ATOM_WM_CLASS,
 		XCB_ATOM_WM_NAME,
@@ -569,7 +682,7 @@ static void xwm_map_shell_surface(struct wlr_xwm *xwm,
 		xwm->atoms[NET_WM_PID],
 	};
 	for (size_t i = 0; i < sizeof(props)/sizeof(xcb_atom_t); i++) {
-		read_surface_property(xwm, xsurface, props[i]);
+		xwm_request_surface_property(xwm, xsurface, props[i]);
 	}
 
 	wlr_surface_set_role_committed(xsurface->surface, handle_surface_commit,
@@ -578,8 +691,12 @@ static void xwm_map_shell_surface(struct wlr_xwm *xwm,
 	xsurface->surface_destroy.notify = handle_surface_destroy;
 	wl_signal_add(&surface->events.destroy, &xsurface->surface_destroy);
 
-	xsurface->mapped = true;
-	wlr_signal_emit_safe(&xsurface->events.map_notify, xsurface);
+	if (xsurface->pending_properties > 0) {
+		xsurface->map_pending = true;
+		xcb_flush(xwm->xcb_conn);
+	} else {
+		xwm_surface_map(xsurface);
+	}
 }
 
 static void xwm_handle_create_notify(struct wlr_xwm *xwm,
@@ -708,6 +825,7 @@ static void xwm_handle_unmap_notify(struct wlr_xwm *xwm,
 		wl_list_remove(&xsurface->surface_destroy.link);
 	}
 	xsurface->surface = NULL;
+	xsurface->map_pending = false;
 
 	if (xsurface->mapped) {
 		xsurface->mapped = false;
@@ -725,7 +843,7 @@ static void xwm_handle_property_notify(struct wlr_xwm *xwm,
 		return;
 	}
 
-	read_surface_property(xwm, xsurface, ev->atom);
+	xwm_request_surface_property(xwm, xsurface, ev->atom);
 }
 
 static void xwm_handle_surface_id_message(struct wlr_xwm *xwm,
@@ -743,11 +861,13 @@ static void xwm_handle_surface_id_message(struct wlr_xwm *xwm,
 		wl_client_get_object(xwm->xwayland->client, id);
 	if (resource) {
 		struct wlr_surface *surface = wl_resource_get_user_data(resource);
-		xsurface->surface_id = 0;
+		if (xsurface->surface_id) {
+			wl_list_remove(&xsurface->unpaired_link);
+			xsurface->surface_id = 0;
+		}
 		xwm_map_shell_surface(xwm, xsurface, surface);
 	} else {
-		xsurface->surface_id = id;
-		wl_list_insert(&xwm->unpaired_surfaces, &xsurface->unpaired_link);
+		xwm_add_unpaired_surface(xwm, xsurface, id);
 	}
 }
 
@@ -952,6 +1072,64 @@ static void xwm_handle_focus_in(struct wlr_xwm *xwm,
  * others redefine anyway is meh
  */
 #define XCB_EVENT_RESPONSE_TYPE_MASK (0x7f)
+/**
+ * Returns false if the event was taken over by the user event handler and no
+ * more events should be processed.
+ */
+static bool xwm_handle_event(struct wlr_xwm *xwm, xcb_generic_event_t *event) {
+	if (xwm->xwayland->user_event_handler &&
+			xwm->xwayland->user_event_handler(xwm, event)) {
+		return false;
+	}
+
+	if (xwm_handle_selection_event(xwm, event)) {
+		free(event);
+		return true;
+	}
+
+	switch (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) {
+	case XCB_CREATE_NOTIFY:
+		xwm_handle_create_notify(xwm, (xcb_create_notify_event_t *)event);
+		break;
+	case XCB_DESTROY_NOTIFY:
+		xwm_handle_destroy_notify(xwm, (xcb_destroy_notify_event_t *)event);
+		break;
+	case XCB_CONFIGURE_REQUEST:
+		xwm_handle_configure_request(xwm,
+			(xcb_configure_request_event_t *)event);
+		break;
+	case XCB_CONFIGURE_NOTIFY:
+		xwm_handle_configure_notify(xwm,
+			(xcb_configure_notify_event_t *)event);
+		break;
+	case XCB_MAP_REQUEST:
+		xwm_handle_map_request(xwm, (xcb_map_request_event_t *)event);
+		break;
+	case XCB_MAP_NOTIFY:
+		xwm_handle_map_notify(xwm, (xcb_map_notify_event_t *)event);
+		break;
+	case XCB_UNMAP_NOTIFY:
+		xwm_handle_unmap_notify(xwm, (xcb_unmap_notify_event_t *)event);
+		break;
+	case XCB_PROPERTY_NOTIFY:
+		xwm_handle_property_notify(xwm,
+			(xcb_property_notify_event_t *)event);
+		break;
+	case XCB_CLIENT_MESSAGE:
+		xwm_handle_client_message(xwm, (xcb_client_message_event_t *)event);
+		break;
+	case XCB_FOCUS_IN:
+		xwm_handle_focus_in(xwm, (xcb_focus_in_event_t *)event);
+		break;
+	default:
+		wlr_log(L_DEBUG, "X11 event: %d",
+			event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK);
+		break;
+	}
+	free(event);
+	return true;
+}
+
 static int x11_event_handler(int fd, uint32_t mask, void *data) {
 	int count = 0;
 	xcb_generic_event_t *event;
@@ -959,59 +1137,28 @@ static int x11_event_handler(int fd, uint32_t mask, void *data) {
 
 	while ((event = xcb_poll_for_event(xwm->xcb_conn))) {
 		count++;
-
-		if (xwm->xwayland->user_event_handler &&
-				xwm->xwayland->user_event_handler(xwm, event)) {
-			break;
+		if (!xwm_handle_event(xwm, event)) {
+			goto flush;
 		}
+	}
 
-		if (xwm_handle_selection_event(xwm, event)) {
-			free(event);
-			continue;
+	// Polling for replies reads from the connection, events read along with
+	// them are queued and won't make the fd readable again
+	int n;
+	do {
+		n = xwm_handle_property_replies(xwm);
+		n += xwm_handle_selection_replies(xwm);
+		while ((event = xcb_poll_for_queued_event(xwm->xcb_conn))) {
+			n++;
+			if (!xwm_handle_event(xwm, event)) {
+				count += n;
+				goto flush;
+			}
 		}
+		count += n;
+	} while (n > 0);
 
-		switch (event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK) {
-		case XCB_CREATE_NOTIFY:
-			xwm_handle_create_notify(xwm, (xcb_create_notify_event_t *)event);
-			break;
-		case XCB_DESTROY_NOTIFY:
-			xwm_handle_destroy_notify(xwm, (xcb_destroy_notify_event_t *)event);
-			break;
-		case XCB_CONFIGURE_REQUEST:
-			xwm_handle_configure_request(xwm,
-				(xcb_configure_request_event_t *)event);
-			break;
-		case XCB_CONFIGURE_NOTIFY:
-			xwm_handle_configure_notify(xwm,
-				(xcb_configure_notify_event_t *)event);
-			break;
-		case XCB_MAP_REQUEST:
-			xwm_handle_map_request(xwm, (xcb_map_request_event_t *)event);
-			break;
-		case XCB_MAP_NOTIFY:
-			xwm_handle_map_notify(xwm, (xcb_map_notify_event_t *)event);
-			break;
-		case XCB_UNMAP_NOTIFY:
-			xwm_handle_unmap_notify(xwm, (xcb_unmap_notify_event_t *)event);
-			break;
-		case XCB_PROPERTY_NOTIFY:
-			xwm_handle_property_notify(xwm,
-				(xcb_property_notify_event_t *)event);
-			break;
-		case XCB_CLIENT_MESSAGE:
-			xwm_handle_client_message(xwm, (xcb_client_message_event_t *)event);
-			break;
-		case XCB_FOCUS_IN:
-			xwm_handle_focus_in(xwm, (xcb_focus_in_event_t *)event);
-			break;
-		default:
-			wlr_log(L_DEBUG, "X11 event: %d",
-				event->response_type & XCB_EVENT_RESPONSE_TYPE_MASK);
-			break;
-		}
-		free(event);
-	}
-
+flush:
 	if (count) {
 		xcb_flush(xwm->xcb_conn);
 	}
@@ -1031,16 +1178,16 @@ static void handle_compositor_surface_create(struct wl_listener *listener,
 	wlr_log(L_DEBUG, "New xwayland surface: %p", surface);
 
 	uint32_t surface_id = wl_resource_get_id(surface->resource);
-	struct wlr_xwayland_surface *xsurface;
-	wl_list_for_each(xsurface, &xwm->unpaired_surfaces, unpaired_link) {
-		if (xsurface->surface_id == surface_id) {
-			xwm_map_shell_surface(xwm, xsurface, surface);
-			xsurface->surface_id = 0;
-			wl_list_remove(&xsurface->unpaired_link);
-			xcb_flush(xwm->xcb_conn);
-			return;
-		}
+	struct wlr_xwayland_surface *xsurface =
+		lookup_unpaired_surface(xwm, surface_id);
+	if (xsurface == NULL) {
+		return;
 	}
+
+	xwm_map_shell_surface(xwm, xsurface, surface);
+	xsurface->surface_id = 0;
+	wl_list_remove(&xsurface->unpaired_link);
+	xcb_flush(xwm->xcb_conn);
 }
 
 void wlr_xwayland_surface_activate(struct wlr_xwayland_surface *xsurface,
@@ -1118,11 +1265,14 @@ void xwm_destroy(struct wlr_xwm *xwm) {
 		wl_event_source_remove(xwm->event_source);
 	}
 	struct wlr_xwayland_surface *xsurface, *tmp;
+	// Unpaired surfaces are also in the surface list
 	wl_list_for_each_safe(xsurface, tmp, &xwm->surfaces, link) {
 		wlr_xwayland_surface_destroy(xsurface);
 	}
-	wl_list_for_each_safe(xsurface, tmp, &xwm->unpaired_surfaces, link) {
-		wlr_xwayland_surface_destroy(xsurface);
+	struct xwm_property_request *request, *request_tmp;
+	wl_list_for_each_safe(request, request_tmp, &xwm->property_requests,
+			link) {
+		xwm_property_request_destroy(request);
 	}
 	wl_list_remove(&xwm->compositor_surface_create.link);
 	xcb_disconnect(xwm->xcb_conn);
@@ -1340,7 +1490,11 @@ struct wlr_xwm *xwm_create(struct wlr_xwayland *wlr_xwayland) {
 
 	xwm->xwayland = wlr_xwayland;
 	wl_list_init(&xwm->surfaces);
-	wl_list_init(&xwm->unpaired_surfaces);
+	for (size_t i = 0; i < XWM_SURFACE_BUCKETS; ++i) {
+		wl_list_init(&xwm->surfaces_by_window[i]);
+		wl_list_init(&xwm->unpaired_surfaces[i]);
+	}
+	wl_list_init(&xwm->property_requests);
 
 	xwm->xcb_conn = xcb_connect_to_fd(wlr_xwayland->wm_fd[0], NULL);
 